@@ -0,0 +1,75 @@
+/*
+  POTA_Peer_Seeding.ino - Example for POTA library
+  ------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air/
+
+  Description:
+    This example demonstrates LAN peer seeding. Every device serves
+    its own running firmware to its neighbours (advertised via mDNS)
+    and, when an update is available, first tries to download it from
+    the fastest neighbour already running it. The image is verified
+    against the signed checksum from the POTA service; if no peer has
+    it, or verification fails, the update is fetched from the cloud.
+
+  Usage:
+    - Edit secrets.h to set:
+        * WIFI_SSID, WIFI_PASSWORD → your Wi-Fi network
+        * DEVICE_TYPE → select the correct board (ESP32)
+        * FIRMWARE_VERSION → firmware version string
+        * AUTH_TOKEN, SERVER_SECRET → values obtained from registering
+          your device at pleasedontcode.com (Please Over The Air service)
+    - Flash the same sketch to several devices on the same network.
+
+  Compatible boards:
+    - ESP32
+*/
+
+#include "secrets.h" // Contains WIFI_SSID, WIFI_PASSWORD, DEVICE_TYPE, FIRMWARE_VERSION, AUTH_TOKEN, SERVER_SECRET
+#include <POTA.h>
+
+POTA ota;
+
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+
+  // ℹ️ Print firmware + device info
+  Serial.println("\n🔧 Starting device...");
+  Serial.print("💻 Device Type: ");
+  Serial.println(DEVICE_TYPE);
+  Serial.print("📦 Firmware Version: ");
+  Serial.println(FIRMWARE_VERSION);
+
+  // 1️⃣ Library handles Wi-Fi connection internally
+  POTAError err = ota.begin(WIFI_SSID, WIFI_PASSWORD, DEVICE_TYPE, FIRMWARE_VERSION, AUTH_TOKEN, SERVER_SECRET);
+  if (err != POTAError::SUCCESS) {
+    Serial.print("\n❌ POTA begin failed: ");
+    Serial.println(ota.errorToString(err));
+    return;
+  }
+
+  // 2️⃣ Serve our own firmware to LAN neighbours
+  err = ota.beginSeeder();
+  if (err != POTAError::SUCCESS) {
+    Serial.print("❌ Seeder start failed: ");
+    Serial.println(ota.errorToString(err));
+  }
+
+  // 3️⃣ Try LAN peers first, then the cloud
+  ota.setPeerFetch(true);
+  err = ota.checkAndPerformOTA();
+  if (err == POTAError::NO_UPDATE_AVAILABLE) {
+    Serial.println("✅ Firmware already up to date");
+  } else if (err != POTAError::SUCCESS) {
+    Serial.print("❌ OTA error: ");
+    Serial.println(ota.errorToString(err));
+  }
+}
+
+void loop() {
+  // Keep serving peers
+  ota.loop();
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// ========================
+// Wi-Fi Credentials
+// ========================
+#define WIFI_SSID "your-ssid"
+#define WIFI_PASSWORD "your-password"
+
+// ========================
+// Authentication
+// ========================
+#define AUTH_TOKEN "kyDJQdiAqDm2p-DCDkJKngkKzNRO6roKDYxYR7-8i3Y"
+#define SERVER_SECRET "6d4599bf8f6497e40fb9d8eec9eb7071d7c386918c9ef88338aa77f6857a4ed9"
+
+// ========================
+// Firmware Version
+// ========================
+#define FIRMWARE_VERSION "1.0.0" 
+
+// ========================
+// Device Type Selection
+// Choose ONE by uncommenting
+// ========================
+// #define DEVICE_TYPE "ESP32_DEVKIT_V1"
+// #define DEVICE_TYPE "XIAO_ESP32S3"
+// #define DEVICE_TYPE "ARDUINO_OPTA_WIFI"
+// #define DEVICE_TYPE "ARDUINO_NANO_ESP32"
+// #define DEVICE_TYPE "ESP8266_NODEMCU_V1_0"
\ No newline at end of file
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+  gen_ca_bundle.py - CA bundle generator for the POTA library
+  ------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+
+  Description:
+    Turns a set of PEM root certificates into src/POTACertBundle.h, a
+    compact bundle in which the issuing root is found by lookup rather
+    than by parsing every certificate on each connect:
+      - ESP32: ESP-IDF esp_crt_bundle format (roots sorted by subject
+        DN, each stored as subject DN + public key), searched by the
+        bundle verify callback.
+      - ESP8266: DER certificates indexed by SHA-256 of their subject
+        DN, sorted for binary search from a BearSSL CertStore.
+      - Arduino Opta: the PEM certificates, appended to the client. The
+        client parses every appended root on each handshake.
+
+    Only the standard library is used.
+
+  Usage:
+    python3 gen_ca_bundle.py ISRG_Root_X1.pem ISRG_Root_X2.pem \\
+        [more.pem ...] [-o ../../src/POTACertBundle.h]
+"""
+
+import argparse
+import base64
+import hashlib
+import os
+import re
+import struct
+import sys
+
+PEM_RE = re.compile(
+    r"-----BEGIN CERTIFICATE-----\s*(.+?)\s*-----END CERTIFICATE-----", re.S)
+
+
+def der_element(data, pos):
+    """Return (start, content_start, end) of the DER element at `pos`."""
+    length = data[pos + 1]
+    header = 2
+    if length & 0x80:
+        count = length & 0x7F
+        length = int.from_bytes(data[pos + 2:pos + 2 + count], "big")
+        header += count
+    return pos, pos + header, pos + header + length
+
+
+def parse_cert(der):
+    """Extract the subject DN and SubjectPublicKeyInfo (both DER) of a certificate."""
+    _, cert_body, _ = der_element(der, 0)
+    _, tbs_body, tbs_end = der_element(der, cert_body)
+    fields = []
+    pos = tbs_body
+    while pos < tbs_end:
+        start, _, end = der_element(der, pos)
+        fields.append(der[start:end])
+        pos = end
+    if fields[0][0] == 0xA0:  # Explicit [0] version
+        fields = fields[1:]
+    # serial, signature, issuer, validity, subject, subjectPublicKeyInfo
+    return fields[4], fields[5]
+
+
+def load_certs(paths):
+    certs = []
+    for path in paths:
+        with open(path, "r", encoding="ascii") as f:
+            text = f.read()
+        blocks = PEM_RE.findall(text)
+        if not blocks:
+            sys.exit("%s: no certificate found" % path)
+        for block in blocks:
+            der = base64.b64decode("".join(block.split()))
+            subject, spki = parse_cert(der)
+            pem = "-----BEGIN CERTIFICATE-----\n%s\n-----END CERTIFICATE-----\n" % block.strip()
+            certs.append({"der": der, "subject": subject, "spki": spki, "pem": pem,
+                          "name": os.path.basename(path)})
+    return certs
+
+
+def c_bytes(data, indent="    "):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append(indent + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "\n".join(lines)
+
+
+def generate(certs):
+    # --- ESP32: esp_crt_bundle (count, then name_len, key_len, name, key per root) ---
+    esp = sorted(certs, key=lambda c: c["subject"])
+    bundle = struct.pack(">H", len(esp))
+    for c in esp:
+        bundle += struct.pack(">HH", len(c["subject"]), len(c["spki"])) + c["subject"] + c["spki"]
+
+    # --- ESP8266: DER blob indexed by SHA-256(subject DN) ---
+    hashed = sorted(certs, key=lambda c: hashlib.sha256(c["subject"]).digest())
+    blob = b""
+    index = []
+    for c in hashed:
+        index.append((hashlib.sha256(c["subject"]).digest(), len(blob), len(c["der"])))
+        blob += c["der"]
+
+    names = ", ".join(c["name"] for c in certs)
+    out = []
+    out.append("""/*
+  POTACertBundle.h - Root CA bundle for the POTA library
+  ------------------------------------------------------
+  Generated by extras/ca_bundle/gen_ca_bundle.py - do not edit.
+
+  Roots: %s
+
+  Description:
+    Only include from POTA.cpp. Each platform compiles just the
+    representation it uses (see gen_ca_bundle.py).
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#define POTA_CA_BUNDLE_COUNT %d
+""" % (names, len(certs)))
+
+    out.append("#if defined(ESP32)")
+    out.append("// esp_crt_bundle format, roots sorted by subject DN")
+    out.append("static const uint8_t pota_ca_bundle[] = {")
+    out.append(c_bytes(bundle))
+    out.append("};")
+    out.append("")
+    out.append("#elif defined(ESP8266)")
+    out.append("// One entry per root, sorted by SHA-256 of the subject DN")
+    out.append("struct POTACaIndexEntry {")
+    out.append("    uint8_t subjectHash[32];")
+    out.append("    uint16_t offset;  // Offset of the DER certificate in pota_ca_der")
+    out.append("    uint16_t length;")
+    out.append("};")
+    out.append("")
+    out.append("static const POTACaIndexEntry pota_ca_index[] PROGMEM = {")
+    for digest, offset, length in index:
+        out.append("    { { %s }, %d, %d }," % (", ".join("0x%02x" % b for b in digest), offset, length))
+    out.append("};")
+    out.append("")
+    out.append("static const uint8_t pota_ca_der[] PROGMEM = {")
+    out.append(c_bytes(blob))
+    out.append("};")
+    out.append("")
+    out.append("#elif defined(ARDUINO_OPTA)")
+    out.append("static const char* const pota_ca_pem[] = {")
+    for c in certs:
+        out.append('    R"EOF(\n%s)EOF",' % c["pem"])
+    out.append("};")
+    out.append("#endif")
+    out.append("")
+    return "\n".join(out)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description="Generate the POTA root CA bundle")
+    parser.add_argument("pem", nargs="+", help="PEM files with root certificates")
+    parser.add_argument("-o", "--output", default=os.path.join(here, "..", "..", "src", "POTACertBundle.h"))
+    args = parser.parse_args()
+
+    certs = load_certs(args.pem)
+    if len(certs) > 0xFFFF or sum(len(c["der"]) for c in certs) > 0xFFFF:
+        sys.exit("bundle too large")
+    with open(args.output, "w", encoding="ascii", newline="\n") as f:
+        f.write(generate(certs))
+    print("Wrote %d roots to %s" % (len(certs), args.output))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+  gen_chunk_list.py - Chunk hash list generator for the POTA library
+  -------------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+
+  Description:
+    Splits a firmware image into fixed-size chunks and writes the
+    SHA-256 of every chunk, concatenated, to a list file. The SHA-256
+    of that list is the chunk root: published in the signed manifest,
+    it lets the device verify each chunk as it arrives and fetch only
+    a corrupted chunk again instead of the whole image.
+
+    The manifest fields to add are printed on completion:
+      "chunk_size", "chunk_root" and "chunk_list" (URL of the list).
+
+    Only the standard library is used.
+
+  Usage:
+    python3 gen_chunk_list.py firmware.bin \\
+        --url https://example.com/firmware.chunks [--chunk-size 4096] \\
+        [-o firmware.chunks]
+"""
+
+import argparse
+import hashlib
+import json
+import sys
+
+MIN_CHUNK_SIZE = 256
+MAX_CHUNK_SIZE = 4096   # POTA_CHUNK_MAX_SIZE
+MAX_CHUNK_COUNT = 1024  # POTA_CHUNK_MAX_COUNT (256 on ESP8266)
+
+
+def chunk_list(image, chunk_size):
+    """Return the concatenated SHA-256 digests of every chunk of `image`."""
+    return b"".join(hashlib.sha256(image[i:i + chunk_size]).digest()
+                    for i in range(0, len(image), chunk_size))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a POTA chunk hash list")
+    parser.add_argument("image", help="firmware image (.bin)")
+    parser.add_argument("--url", required=True, help="URL the list will be served from")
+    parser.add_argument("--chunk-size", type=int, default=MAX_CHUNK_SIZE)
+    parser.add_argument("-o", "--output", help="list file (default: <image>.chunks)")
+    args = parser.parse_args()
+
+    if not MIN_CHUNK_SIZE <= args.chunk_size <= MAX_CHUNK_SIZE:
+        sys.exit("chunk size must be between %d and %d" % (MIN_CHUNK_SIZE, MAX_CHUNK_SIZE))
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if not image:
+        sys.exit("empty image")
+    count = (len(image) + args.chunk_size - 1) // args.chunk_size
+    if count > MAX_CHUNK_COUNT:
+        sys.exit("%d chunks, at most %d are supported: raise --chunk-size" % (count, MAX_CHUNK_COUNT))
+
+    hashes = chunk_list(image, args.chunk_size)
+    output = args.output or args.image + ".chunks"
+    with open(output, "wb") as f:
+        f.write(hashes)
+    print("Wrote %d chunk hashes to %s" % (count, output))
+    print("Manifest fields:")
+    print(json.dumps({
+        "chunk_size": args.chunk_size,
+        "chunk_root": hashlib.sha256(hashes).hexdigest(),
+        "chunk_list": args.url,
+    }, indent=2))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+  gen_descriptor.py - Local update descriptor generator for the POTA library
+  --------------------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+
+  Description:
+    Writes the signed descriptor POTA::performLocalUpdate() expects next
+    to a firmware image (`<image>.json`). It has the fields of an update
+    server reply and the same server token: an HMAC-SHA256, keyed with
+    the device's server secret, over
+      "true:<version>:<url>:<checksum>:<protocol>:<notes>:<timestamp>"
+    followed by ":<manifest>" when a manifest is present.
+
+    The image SHA-256 and size are filled in from the image itself.
+    Only the standard library is used.
+
+  Usage:
+    python3 gen_descriptor.py firmware.bin --version 1.2.0 \\
+        --secret <server secret> [--notes "Factory image"] \\
+        [--manifest "chip_id=9"] [-o firmware.bin.json]
+"""
+
+import argparse
+import hashlib
+import hmac
+import json
+import time
+
+PROTOCOL_VERSION = "01.00"  # POTA_PROTOCOL_VERSION
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a signed POTA local update descriptor")
+    parser.add_argument("image", help="firmware image (.bin)")
+    parser.add_argument("--version", required=True, help="firmware version of the image")
+    parser.add_argument("--secret", required=True, help="server secret of the target devices")
+    parser.add_argument("--notes", default="", help="release notes")
+    parser.add_argument("--manifest", default="", help='extra signed manifest fields ("key=value;...")')
+    parser.add_argument("--url", default="local", help="informational image location")
+    parser.add_argument("-o", "--output", help="descriptor file (default: <image>.json)")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    checksum = hashlib.sha256(image).hexdigest()
+    fields = [f for f in args.manifest.split(";") if f and not f.startswith("size=")]
+    manifest = ";".join(["size=%d" % len(image)] + fields)
+    timestamp = int(time.time())
+
+    message = ":".join(["true", args.version, args.url, checksum, PROTOCOL_VERSION,
+                        args.notes, str(timestamp), manifest])
+    token = hmac.new(args.secret.encode(), message.encode(), hashlib.sha256).hexdigest()
+
+    descriptor = {
+        "update": True,
+        "version": args.version,
+        "url": args.url,
+        "checksum": checksum,
+        "protocol_version": PROTOCOL_VERSION,
+        "notes": args.notes,
+        "timestamp": timestamp,
+        "manifest": manifest,
+        "server_token": token,
+    }
+    output = args.output or args.image + ".json"
+    with open(output, "w", encoding="utf-8", newline="\n") as f:
+        json.dump(descriptor, f, separators=(",", ":"))
+    print("Wrote %s (%d bytes, sha256 %s)" % (output, len(image), checksum))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,166 @@
+/*
+  pota_mcast_common.h - Shared helpers for the POTA multicast host tools
+  ----------------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+
+  Description:
+    Dependency-free SHA-256 and the carousel transmit loop used by
+    pota_mcast_sender and pota_mcast_bench (Linux / POSIX sockets).
+*/
+
+#pragma once
+
+#include "../../src/POTAMulticast.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+// -------------------- SHA-256 --------------------
+class HostSha256 {
+public:
+    HostSha256() {
+        static const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        memcpy(_h, init, sizeof(_h));
+    }
+
+    void update(const uint8_t* data, size_t len) {
+        _total += len;
+        while (len > 0) {
+            size_t n = 64 - _used;
+            if (n > len) n = len;
+            memcpy(_block + _used, data, n);
+            _used += n;
+            data += n;
+            len -= n;
+            if (_used == 64) {
+                compress(_block);
+                _used = 0;
+            }
+        }
+    }
+
+    void finish(uint8_t* out) {
+        uint64_t bits = _total * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (_used != 56) update(&pad, 1);
+        uint8_t len[8];
+        for (int i = 0; i < 8; ++i) len[i] = (uint8_t)(bits >> (56 - 8 * i));
+        update(len, 8);
+        for (int i = 0; i < 8; ++i) potaMcastPut32(out + 4 * i, _h[i]);
+    }
+
+    static void toHex(const uint8_t* digest, char* out) {
+        for (int i = 0; i < 32; ++i) snprintf(out + 2 * i, 3, "%02x", digest[i]);
+    }
+
+private:
+    uint32_t _h[8];
+    uint8_t _block[64];
+    size_t _used = 0;
+    uint64_t _total = 0;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const uint8_t* p) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) w[i] = potaMcastGet32(p + 4 * i);
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+            uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+            w[i] = w[i-16] + s0 + w[i-7] + s1;
+        }
+        uint32_t a = _h[0], b = _h[1], c = _h[2], d = _h[3], e = _h[4], f = _h[5], g = _h[6], h = _h[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+        }
+        _h[0] += a; _h[1] += b; _h[2] += c; _h[3] += d; _h[4] += e; _h[5] += f; _h[6] += g; _h[7] += h;
+    }
+};
+
+// -------------------- Carousel --------------------
+struct CarouselOptions {
+    uint16_t blockSize = POTA_MCAST_DEFAULT_BLOCK_SIZE;
+    uint16_t groupSize = POTA_MCAST_DEFAULT_GROUP_SIZE;
+    double rateKbps = 4000;   ///< Payload rate limit, 0 = unlimited
+    unsigned cycles = 0;      ///< Carousel passes, 0 = until stopped
+};
+
+/**
+ * @brief Broadcast the image as data blocks followed by one XOR repair block per group.
+ * @return Number of datagrams sent
+ */
+inline uint64_t runCarousel(int sock, const sockaddr_in& dst, const std::vector<uint8_t>& image,
+                            const uint8_t* digest, const CarouselOptions& opt,
+                            const std::atomic<bool>& stop)
+{
+    const uint32_t size = (uint32_t)image.size();
+    const uint32_t blocks = (size + opt.blockSize - 1) / opt.blockSize;
+    std::vector<uint8_t> packet(POTA_MCAST_HEADER_SIZE + opt.blockSize);
+    std::vector<uint8_t> parity(opt.blockSize);
+    uint64_t sent = 0;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t payloadBytes = 0;
+
+    POTAMcastHeader h;
+    h.groupSize = opt.groupSize;
+    h.imageSize = size;
+    h.blockSize = opt.blockSize;
+    memcpy(h.digest, digest, 32);
+
+    auto send = [&](size_t payloadLen) {
+        potaMcastEncodeHeader(h, packet.data());
+        sendto(sock, packet.data(), POTA_MCAST_HEADER_SIZE + payloadLen, 0, (const sockaddr*)&dst, sizeof(dst));
+        ++sent;
+        payloadBytes += payloadLen;
+        if (opt.rateKbps > 0) {
+            auto due = start + std::chrono::microseconds((uint64_t)(payloadBytes * 8 * 1000 / opt.rateKbps));
+            std::this_thread::sleep_until(due);
+        }
+    };
+
+    for (unsigned cycle = 0; (opt.cycles == 0 || cycle < opt.cycles) && !stop; ++cycle) {
+        for (uint32_t first = 0; first < blocks && !stop; first += opt.groupSize) {
+            std::fill(parity.begin(), parity.end(), 0);
+            uint32_t last = first + opt.groupSize < blocks ? first + opt.groupSize : blocks;
+            for (uint32_t i = first; i < last; ++i) {
+                uint32_t offset = i * opt.blockSize;
+                uint32_t len = size - offset < opt.blockSize ? size - offset : opt.blockSize;
+                h.type = POTAMcastType::DATA;
+                h.index = i;
+                h.payloadLen = (uint16_t)len;
+                memcpy(packet.data() + POTA_MCAST_HEADER_SIZE, image.data() + offset, len);
+                for (uint32_t b = 0; b < len; ++b) parity[b] ^= image[offset + b];
+                send(len);
+            }
+            h.type = POTAMcastType::REPAIR;
+            h.index = first / opt.groupSize;
+            h.payloadLen = opt.blockSize;
+            memcpy(packet.data() + POTA_MCAST_HEADER_SIZE, parity.data(), opt.blockSize);
+            send(opt.blockSize);
+        }
+    }
+    return sent;
+}
@@ -0,0 +1,100 @@
+/*
+  pota_mcast_sender.cpp - Linux multicast carousel sender for POTA
+  ----------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+
+  Description:
+    Broadcasts a firmware image to devices using
+    POTA::setMulticastReceive(). The image must be the exact file
+    uploaded to the POTA service: devices only accept the session
+    whose SHA-256 equals the signed `checksum` of their update.
+
+  Build:
+    g++ -std=c++17 -O2 -pthread -o pota_mcast_sender pota_mcast_sender.cpp
+
+  Usage:
+    ./pota_mcast_sender firmware.bin [--group 239.255.80.84] [--port 8071]
+        [--iface 192.168.1.10] [--block 1024] [--fec-group 16]
+        [--rate-kbps 4000] [--cycles 0] [--ttl 1]
+*/
+
+#include "pota_mcast_common.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s firmware.bin [--group G] [--port P] [--iface IP] [--block N]"
+                        " [--fec-group K] [--rate-kbps R] [--cycles C] [--ttl T]\n", argv[0]);
+        return 1;
+    }
+
+    const char* group = POTA_MCAST_DEFAULT_GROUP;
+    const char* iface = nullptr;
+    int port = POTA_MCAST_DEFAULT_PORT;
+    int ttl = 1;
+    CarouselOptions opt;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--group")) group = argv[i + 1];
+        else if (!strcmp(argv[i], "--port")) port = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--iface")) iface = argv[i + 1];
+        else if (!strcmp(argv[i], "--block")) opt.blockSize = (uint16_t)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--fec-group")) opt.groupSize = (uint16_t)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--rate-kbps")) opt.rateKbps = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--cycles")) opt.cycles = (unsigned)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--ttl")) ttl = atoi(argv[i + 1]);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 1; }
+    }
+    if (opt.blockSize == 0 || opt.blockSize > POTA_MCAST_MAX_BLOCK_SIZE || opt.groupSize == 0) {
+        fprintf(stderr, "block size must be 1..%d and FEC group size > 0\n", POTA_MCAST_MAX_BLOCK_SIZE);
+        return 1;
+    }
+
+    // --- Load and hash the image ---
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) { perror(argv[1]); return 1; }
+    std::vector<uint8_t> image;
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) image.insert(image.end(), chunk, chunk + n);
+    fclose(f);
+    if (image.empty()) { fprintf(stderr, "empty image\n"); return 1; }
+
+    uint8_t digest[32];
+    HostSha256 sha;
+    sha.update(image.data(), image.size());
+    sha.finish(digest);
+    char hex[65];
+    HostSha256::toHex(digest, hex);
+
+    // --- Open the multicast socket ---
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) { perror("socket"); return 1; }
+    unsigned char mttl = (unsigned char)ttl;
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &mttl, sizeof(mttl));
+    if (iface) {
+        in_addr addr;
+        inet_pton(AF_INET, iface, &addr);
+        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &addr, sizeof(addr)) < 0) perror("IP_MULTICAST_IF");
+    }
+    sockaddr_in dst = {};
+    dst.sin_family = AF_INET;
+    dst.sin_port = htons(port);
+    if (inet_pton(AF_INET, group, &dst.sin_addr) != 1) { fprintf(stderr, "bad group %s\n", group); return 1; }
+
+    printf("Image:    %s (%zu bytes)\nSHA-256:  %s\nGroup:    %s:%d\n"
+           "Blocks:   %u x %u bytes, 1 repair per %u\nRate:     %.0f kbit/s\n",
+           argv[1], image.size(), hex, group, port,
+           (unsigned)((image.size() + opt.blockSize - 1) / opt.blockSize), opt.blockSize,
+           opt.groupSize, opt.rateKbps);
+
+    std::atomic<bool> stop(false);
+    uint64_t sent = runCarousel(sock, dst, image, digest, opt, stop);
+    printf("Sent %llu datagrams\n", (unsigned long long)sent);
+    close(sock);
+    return 0;
+}
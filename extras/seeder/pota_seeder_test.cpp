@@ -0,0 +1,317 @@
+/*
+  pota_seeder_test.cpp - Loopback test for the POTA LAN seeder
+  ------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+
+  Description:
+    Runs a seeder built on the device's POTASeederRequest over the
+    loopback interface, with the same non-blocking service loop as
+    POTA::serveSeeder() (one peer at a time, request head collected
+    across iterations, silent peers dropped after
+    POTA_SEEDER_REQUEST_TIMEOUT_MS), and checks it from a peer:
+      - full, ranged, open-ended and suffix GETs, HEAD, 404 and 416
+      - a download resumed with a Range request reassembles the image
+      - a request dribbled byte by byte is still answered
+      - a bare connect (the RTT probe of POTA::fetchFromPeer()) does
+        not delay the next peer, and a silent one is dropped in time
+      - an oversized request head is rejected
+
+  Build:
+    g++ -std=c++17 -O2 -pthread -o pota_seeder_test pota_seeder_test.cpp
+
+  Usage:
+    ./pota_seeder_test [--port 18070]
+    Exits with status 0 when every check passes.
+*/
+
+#include "../../src/POTASeeder.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static const char* CHECKSUM = "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff";
+
+static uint32_t nowMs() {
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// -------------------- Seeder --------------------
+// Host counterpart of POTA::serveSeeder(): one call per loop() iteration
+class HostSeeder {
+public:
+    HostSeeder(const std::vector<uint8_t>& image, int port) : _image(image) {
+        _server = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(_server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(_server, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(_server, 4) < 0) {
+            perror("seeder");
+            exit(1);
+        }
+        fcntl(_server, F_SETFL, O_NONBLOCK);
+    }
+    ~HostSeeder() {
+        drop();
+        close(_server);
+    }
+
+    uint32_t dropped = 0;   ///< Peers dropped for not sending a complete request in time
+
+    void serve() {
+        // --- Accept a new peer when idle ---
+        if (_client < 0) {
+            _client = accept(_server, nullptr, nullptr);
+            if (_client < 0) return;
+            fcntl(_client, F_SETFL, O_NONBLOCK);
+            _request.reset();
+            _responding = false;
+            _acceptedAt = nowMs();
+        }
+        if (!_responding && !readRequest()) return;
+
+        // --- Send the next slice of the image ---
+        if (_offset >= _end) {
+            drop();
+            return;
+        }
+        uint32_t n = _end - _offset;
+        if (n > 1024) n = 1024;
+        ssize_t sent = send(_client, _image.data() + _offset, n, MSG_NOSIGNAL);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (sent <= 0) {
+            drop();
+            return;
+        }
+        _offset += (uint32_t)sent;
+    }
+
+private:
+    bool readRequest() {
+        uint8_t buffer[128];
+        while (_request.state() == POTASeederParse::INCOMPLETE) {
+            ssize_t n = recv(_client, buffer, sizeof(buffer), 0);
+            if (n == 0) {           // Peer closed (e.g. an RTT probe)
+                drop();
+                return false;
+            }
+            if (n < 0) break;       // Nothing more for now
+            _request.feed(buffer, (size_t)n);
+        }
+        if (_request.state() == POTASeederParse::INCOMPLETE) {
+            if (nowMs() - _acceptedAt >= POTA_SEEDER_REQUEST_TIMEOUT_MS) {
+                dropped++;
+                drop();
+            }
+            return false;
+        }
+        if (_request.state() == POTASeederParse::INVALID) {
+            drop();
+            return false;
+        }
+
+        uint32_t first = 0, last = 0;
+        int status = _request.resolve((uint32_t)_image.size(), first, last);
+        char header[320];
+        size_t len = POTASeederRequest::formatHeader(header, sizeof(header), status, first, last,
+                                                     (uint32_t)_image.size(), CHECKSUM);
+        _offset = _end = 0;
+        if (status == 200 || status == 206) {
+            _offset = first;
+            _end = _request.head() ? first : last + 1;
+        }
+        _request.reset();
+        if (len == 0 || send(_client, header, len, MSG_NOSIGNAL) != (ssize_t)len) {
+            drop();
+            return false;
+        }
+        _responding = true;
+        return true;
+    }
+
+    void drop() {
+        if (_client >= 0) close(_client);
+        _client = -1;
+    }
+
+    const std::vector<uint8_t>& _image;
+    int _server = -1;
+    int _client = -1;
+    POTASeederRequest _request;
+    bool _responding = false;
+    uint32_t _acceptedAt = 0;
+    uint32_t _offset = 0;
+    uint32_t _end = 0;
+};
+
+// -------------------- Peer --------------------
+struct Response {
+    int status = 0;
+    std::string headers;
+    std::vector<uint8_t> body;
+    bool closedWithoutReply = false;
+};
+
+static int connectTo(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+static Response request(int port, const std::string& raw, bool dribble = false) {
+    int fd = connectTo(port);
+    if (dribble) {
+        for (char c : raw) {
+            send(fd, &c, 1, MSG_NOSIGNAL);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    } else {
+        send(fd, raw.data(), raw.size(), MSG_NOSIGNAL);
+    }
+    std::string data;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) data.append(buffer, (size_t)n);
+    close(fd);
+
+    Response r;
+    size_t end = data.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        r.closedWithoutReply = data.empty();
+        return r;
+    }
+    r.headers = data.substr(0, end + 2);
+    r.status = atoi(data.c_str() + 9);
+    r.body.assign(data.begin() + end + 4, data.end());
+    return r;
+}
+
+static std::string get(const char* path, const char* range = nullptr, bool head = false) {
+    std::string raw = std::string(head ? "HEAD " : "GET ") + path + " HTTP/1.1\r\nHost: seeder\r\n";
+    if (range) raw += std::string("Range: bytes=") + range + "\r\n";
+    return raw + "\r\n";
+}
+
+// -------------------- Checks --------------------
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("%s  %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) failures++;
+}
+
+static bool bodyIs(const Response& r, const std::vector<uint8_t>& image, size_t first, size_t count) {
+    return r.body.size() == count && std::equal(r.body.begin(), r.body.end(), image.begin() + first);
+}
+
+static bool hasHeader(const Response& r, const char* header) {
+    return r.headers.find(header) != std::string::npos;
+}
+
+int main(int argc, char** argv) {
+    int port = 18070;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--port") && i + 1 < argc) port = atoi(argv[++i]);
+    }
+
+    std::vector<uint8_t> image(300000);
+    for (size_t i = 0; i < image.size(); ++i) image[i] = (uint8_t)(i * 131 + (i >> 9));
+    const uint32_t size = (uint32_t)image.size();
+
+    HostSeeder seeder(image, port);
+    std::atomic<bool> stop(false);
+    std::thread loop([&] {
+        while (!stop) {
+            seeder.serve();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+
+    Response r = request(port, get(POTA_SEEDER_PATH));
+    check(r.status == 200 && bodyIs(r, image, 0, size), "full GET returns the image");
+    check(hasHeader(r, "X-POTA-Checksum: 00112233"), "response advertises the checksum");
+
+    r = request(port, get(POTA_SEEDER_PATH, "100-199"));
+    check(r.status == 206 && bodyIs(r, image, 100, 100) && hasHeader(r, "Content-Range: bytes 100-199/300000"),
+          "closed range");
+
+    r = request(port, get(POTA_SEEDER_PATH, "299000-"));
+    check(r.status == 206 && bodyIs(r, image, 299000, 1000), "open-ended range");
+
+    r = request(port, get(POTA_SEEDER_PATH, "-50"));
+    check(r.status == 206 && bodyIs(r, image, size - 50, 50), "suffix range");
+
+    r = request(port, get(POTA_SEEDER_PATH, "299990-400000"));
+    check(r.status == 206 && bodyIs(r, image, 299990, 10), "range past the end is clamped");
+
+    r = request(port, get(POTA_SEEDER_PATH, "300000-"));
+    check(r.status == 416 && hasHeader(r, "Content-Range: bytes */300000") && r.body.empty(),
+          "unsatisfiable range");
+
+    r = request(port, get(POTA_SEEDER_PATH, nullptr, true));
+    check(r.status == 200 && hasHeader(r, "Content-Length: 300000") && r.body.empty(), "HEAD sends headers only");
+
+    r = request(port, get("/other.bin"));
+    check(r.status == 404 && r.body.empty(), "unknown path");
+
+    // Interrupted download resumed from where it stopped, as streamImage() does
+    Response part1 = request(port, get(POTA_SEEDER_PATH, "0-123455"));
+    Response part2 = request(port, get(POTA_SEEDER_PATH, "123456-"));
+    std::vector<uint8_t> joined = part1.body;
+    joined.insert(joined.end(), part2.body.begin(), part2.body.end());
+    check(part1.status == 206 && part2.status == 206 && joined == image, "resumed download reassembles the image");
+
+    r = request(port, "GET " POTA_SEEDER_PATH " HTTP/1.1\nRange: bytes=10-19\n\n", true);
+    check(r.status == 206 && bodyIs(r, image, 10, 10), "dribbled request with bare LF line endings");
+
+    // RTT probe: connect and close without a request, then a real peer right away
+    close(connectTo(port));
+    uint32_t t0 = nowMs();
+    r = request(port, get(POTA_SEEDER_PATH, "0-9"));
+    uint32_t elapsed = nowMs() - t0;
+    check(r.status == 206 && elapsed < POTA_SEEDER_REQUEST_TIMEOUT_MS / 4, "bare probe does not stall the next peer");
+
+    // Silent peer: kept open without a request, dropped after the timeout
+    int silent = connectTo(port);
+    t0 = nowMs();
+    char byte;
+    ssize_t n = recv(silent, &byte, 1, 0);
+    elapsed = nowMs() - t0;
+    close(silent);
+    check(n == 0 && elapsed >= POTA_SEEDER_REQUEST_TIMEOUT_MS - 100 && elapsed < POTA_SEEDER_REQUEST_TIMEOUT_MS * 2,
+          "silent peer is dropped after the request timeout");
+
+    std::string huge = "GET " POTA_SEEDER_PATH " HTTP/1.1\r\nX-Pad: " + std::string(POTA_SEEDER_REQUEST_MAX, 'a') + "\r\n\r\n";
+    r = request(port, huge);
+    check(r.closedWithoutReply, "oversized request head is rejected");
+
+    r = request(port, "POST " POTA_SEEDER_PATH " HTTP/1.1\r\n\r\n");
+    check(r.closedWithoutReply, "other methods are rejected");
+
+    stop = true;
+    loop.join();
+    printf("%s (%u peers timed out)\n", failures ? "FAILED" : "ALL PASSED", seeder.dropped);
+    return failures ? 1 : 0;
+}
@@ -26,19 +26,117 @@
 
 #include "POTA.h"
 #include "certificates.h"
+#include "POTACertBundle.h"
+#include "POTAStore.h"
 #include <ArduinoJson.h>
+#include <limits.h>
 #if defined(ARDUINO_OPTA)
     #include "opta_info.h"
-    #include <mbedtls/md.h>
+    #include <mbed_rtc_time.h>
+    #include <mbed_retarget.h>
+    #include <mbed_power_mgmt.h>
+#endif
+#if defined(ESP32) || defined(ESP8266)
+    #include <sys/time.h>
 #endif
 #if defined(ESP32)
     #include <esp_idf_version.h> 
-    #include <mbedtls/md.h>
+    #include <esp_arduino_version.h>
+    #if ESP_ARDUINO_VERSION_MAJOR >= 3
+        #include <esp_crt_bundle.h>
+    #endif
+    #include <esp_pm.h>
+    #include <lwip/tcpip.h>
+#endif
+#if defined(ESP8266)
+    extern "C" {
+        #include <user_interface.h>
+    }
 #endif
 
 #define POTA_PROTOCOL_VERSION "01.00"
 #define API_HOST "www.pleasedontcode.com"
 #define CHECK_UPDATE_API "/api/v1/check_update/"
+#define POTA_STREAM_BUFFER_SIZE 1024    // Chunk size used when streaming images
+#define POTA_HTTP_TIMEOUT_MS 10000      // Inactivity timeout for image transfers
+#define POTA_DOWNLOAD_RETRIES 3         // Range resume attempts after a dropped transfer
+#define POTA_MCAST_IDLE_TIMEOUT_MS 10000 // Give up on a silent multicast carousel
+#define POTA_DNS_RETRY_MS 30000         // Back-off after a failed background DNS refresh
+#define POTA_THROTTLE_SLICE_MS 20       // Longest single wait of the rate limiter, so limit changes apply quickly
+#define POTA_MIRROR_PROBE_MS 1500       // Deadline of the mirror connect probes
+
+#if defined(ARDUINO_OPTA)
+#define POTA_OPTA_UPDATE_FILE "/fs/UPDATE.BIN.LZSS" // File Arduino_Portenta_OTA decompresses from
+
+// Single QSPI OTA instance: begin() mounts the update file system, which must only happen once
+static Arduino_Portenta_OTA_QSPI& optaOta() {
+    static Arduino_Portenta_OTA_QSPI ota(QSPI_FLASH_FATFS_MBR, 2);
+    return ota;
+}
+
+static POTAError optaBegin() {
+    static bool begun = false;
+    if (begun) return POTAError::SUCCESS;
+    if (!optaOta().isOtaCapable()) return POTAError::OTA_NOT_CAPABLE;
+    if (optaOta().begin() != Arduino_Portenta_OTA::Error::None) return POTAError::OTA_BEGIN_FAILED;
+    begun = true;
+    return POTAError::SUCCESS;
+}
+#endif
+
+#if defined(ESP8266)
+// -------------------- CA Bundle (ESP8266) --------------------
+namespace {
+
+// BearSSL trust anchor lookup over the generated bundle: the issuer's subject
+// hash is binary-searched in the index and only that root is decoded
+class POTACertStore : public CertStoreBase {
+public:
+    void installCertStore(br_x509_minimal_context* ctx) override {
+        br_x509_minimal_set_dynamic(ctx, this, findHashedTA, freeHashedTA);
+    }
+
+private:
+    X509List* _current = nullptr;
+
+    static const br_x509_trust_anchor* findHashedTA(void* ctx, void* hashedDn, size_t len) {
+        POTACertStore* store = static_cast<POTACertStore*>(ctx);
+        if (!store || len != 32) return nullptr;
+        delete store->_current;
+        store->_current = nullptr;
+
+        size_t lo = 0;
+        size_t hi = POTA_CA_BUNDLE_COUNT;
+        POTACaIndexEntry entry;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            memcpy_P(&entry, &pota_ca_index[mid], sizeof(entry));
+            int cmp = memcmp(hashedDn, entry.subjectHash, 32);
+            if (cmp == 0) {
+                // Index and certificates live in flash; decode a RAM copy
+                uint8_t* der = new (std::nothrow) uint8_t[entry.length];
+                if (!der) return nullptr;
+                memcpy_P(der, pota_ca_der + entry.offset, entry.length);
+                store->_current = new (std::nothrow) X509List(der, entry.length);
+                delete[] der;
+                return store->_current ? store->_current->getTrustAnchors() : nullptr;
+            }
+            if (cmp < 0) hi = mid;
+            else lo = mid + 1;
+        }
+        return nullptr;
+    }
+
+    static void freeHashedTA(void* ctx, const br_x509_trust_anchor* ta) {
+        (void)ta;
+        POTACertStore* store = static_cast<POTACertStore*>(ctx);
+        delete store->_current;
+        store->_current = nullptr;
+    }
+};
+
+} // namespace
+#endif
 
 // -------------------- Constructor --------------------
 POTA::POTA() {
@@ -47,6 +145,9 @@ POTA::POTA() {
     _firmwareVersion[0] = '\0';
     _authToken[0] = '\0';
     _serverSecret[0] = '\0';
+#if defined(ESP32) || defined(ESP8266)
+    _runningChecksum[0] = '\0';
+#endif
 }
 
 // -------------------- Public API --------------------
@@ -124,6 +225,8 @@ POTAError POTA::beginClient(WiFiSSLClient& client,
     strncpy(_serverSecret, serverSecret, sizeof(_serverSecret) - 1);
     _serverSecret[sizeof(_serverSecret) - 1] = '\0';
 
+    resumeCanary();
+    restoreStagedUpdate();
     return POTAError::SUCCESS;
 }
 
@@ -154,16 +257,537 @@ String POTA::getSecureMACAddress() {
 
 // -------------------- OTA Handling --------------------
 POTAError POTA::checkAndPerformOTA() {
+    // Check straight into the member descriptor to keep the stack small
+    POTAError err = checkForUpdate(_update);
+    if (err != POTAError::SUCCESS) return err;
+    return performUpdate(_update);
+}
+
+static bool manifestGet(const char* manifest, const char* key, char* out, size_t outSize);
+
+namespace {
+// Marks performUpdate() as running so cancel()/pause() have a download to act on
+class POTATransferScope {
+public:
+    POTATransferScope(volatile bool& active, volatile bool& cancel, volatile bool& pause, volatile bool& hold)
+        : _active(active), _cancel(cancel), _pause(pause), _hold(hold) {
+        _cancel = _pause = _hold = false;
+        _active = true;
+    }
+    ~POTATransferScope() {
+        _active = false;
+        _cancel = _pause = _hold = false;
+    }
+
+private:
+    volatile bool& _active;
+    volatile bool& _cancel;
+    volatile bool& _pause;
+    volatile bool& _hold;
+};
+
+// -------------------- Performance Profile --------------------
+#if defined(ESP32) && CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t potaCpuLock = nullptr;
+static esp_pm_lock_handle_t potaSleepLock = nullptr;
+#endif
+
+// Full CPU clock and an awake radio for the lifetime of the scope; nested
+// scopes (checkAndPerformOTA) leave the work to the outermost one
+class POTAPerformanceScope {
+public:
+    POTAPerformanceScope(bool enabled, POTAStats& stats)
+        : _stats(stats), _entered(enabled), _owner(enabled && _depth == 0) {
+        if (!_entered) return;
+        ++_depth;
+        if (!_owner) return;
+        _stats.profileSavedMs = 0;
+        _start = millis();
+        boost();
+    }
+
+    ~POTAPerformanceScope() {
+        if (!_entered) return;
+        --_depth;
+        if (!_owner) return;
+        restore();
+        _stats.profileTimeMs = millis() - _start;
+        _stats.profileEnergyUah = (uint32_t)((uint64_t)POTA_PROFILE_EXTRA_MA * _stats.profileTimeMs / 3600);
+    }
+
+    static bool active() { return _depth > 0; }
+
+private:
+    void boost() {
+#if defined(ESP32)
+    #if CONFIG_PM_ENABLE
+        // Dynamic frequency scaling owns the clock: hold it at maximum instead
+        if (!potaCpuLock) esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "pota_cpu", &potaCpuLock);
+        if (!potaSleepLock) esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "pota_sleep", &potaSleepLock);
+        if (potaCpuLock) esp_pm_lock_acquire(potaCpuLock);
+        if (potaSleepLock) esp_pm_lock_acquire(potaSleepLock);
+    #else
+        _cpuMhz = getCpuFrequencyMhz();
+        if (_cpuMhz < 240 && !setCpuFrequencyMhz(240) && _cpuMhz < 160) setCpuFrequencyMhz(160);
+    #endif
+        _radioSleep = WiFi.getSleep();
+        WiFi.setSleep(false);
+#elif defined(ESP8266)
+        _cpuMhz = system_get_cpu_freq();
+        if (_cpuMhz < 160) system_update_cpu_freq(SYS_CPU_160MHZ);
+        _sleepMode = WiFi.getSleepMode();
+        WiFi.setSleepMode(WIFI_NONE_SLEEP);
+#elif defined(ARDUINO_OPTA)
+        sleep_manager_lock_deep_sleep(); // The core already runs at full clock
+#endif
+    }
+
+    void restore() {
+#if defined(ESP32)
+    #if CONFIG_PM_ENABLE
+        if (potaSleepLock) esp_pm_lock_release(potaSleepLock);
+        if (potaCpuLock) esp_pm_lock_release(potaCpuLock);
+    #else
+        if (getCpuFrequencyMhz() != _cpuMhz) setCpuFrequencyMhz(_cpuMhz);
+    #endif
+        WiFi.setSleep(_radioSleep);
+#elif defined(ESP8266)
+        if (system_get_cpu_freq() != _cpuMhz) system_update_cpu_freq(_cpuMhz);
+        WiFi.setSleepMode(_sleepMode);
+#elif defined(ARDUINO_OPTA)
+        sleep_manager_unlock_deep_sleep();
+#endif
+    }
+
+    static uint8_t _depth;
+    POTAStats& _stats;
+    bool _entered;
+    bool _owner;
+    unsigned long _start = 0;
+#if defined(ESP32)
+    uint32_t _cpuMhz = 0;
+    bool _radioSleep = false;
+#elif defined(ESP8266)
+    uint8_t _cpuMhz = 0;
+    WiFiSleepType_t _sleepMode = WIFI_NONE_SLEEP;
+#endif
+};
+
+uint8_t POTAPerformanceScope::_depth = 0;
+}
+
+void POTA::setPerformanceProfile(bool enabled) {
+    _performanceProfile = enabled;
+}
+
+void POTA::restartDevice() {
+#if defined(ESP32)
+    esp_restart();
+#elif defined(ESP8266)
+    ESP.restart();
+#elif defined(ARDUINO_OPTA)
+    delay(1000);
+    optaOta().reset();
+#endif
+}
+
+POTAError POTA::performUpdate(const POTAUpdateInfo& info) {
+    if (coroutineActive()) return POTAError::OPERATION_IN_PROGRESS;
     if (!_client) return POTAError::CLIENT_NOT_INITIALIZED;
+    if (!info.available) return POTAError::NO_UPDATE_AVAILABLE;
+    if (&info != &_update) _update = info;
+    POTATransferScope transfer(_transferActive, _cancelRequested, _pauseRequested, _holdTransfer);
+    POTAPerformanceScope profile(_performanceProfile, _stats);
+    POTAError result;
+    if (!prepareUpdate(result)) return result;
+
+#if defined(ESP32)
+    // Prefer a LAN seeder; the image is verified against the signed checksum
+    if (_peerFetch && _sink->isLocal()) {
+        POTAError err = fetchFromPeer();
+        if (err == POTAError::SUCCESS) return completeUpdate();
+        if (err == POTAError::DOWNLOAD_CANCELLED || err == POTAError::DOWNLOAD_DEFERRED) return err;
+        Serial.print("⚠️ Peer download unavailable (");
+        Serial.print(errorToString(err));
+        Serial.println("), falling back to cloud");
+    }
+#endif
+
+    // Metered link: prefer the signed compact image, and never start what the budget cannot finish
+    loadUsage();
+    if (_dataBudget) {
+#if defined(ESP8266)
+        // Only the ESP8266 updater takes a compressed image as is (eboot inflates it when
+        // installing); ESP32 needs a raw app image and Opta images are already LZSS
+        char compactUrl[sizeof(_update.url)];
+        char compactChecksum[POTA_SHA256_HEX_SIZE];
+        char compactSize[16];
+        if (_sink->isLocal() &&
+            manifestGet(_update.manifest, "compact_url", compactUrl, sizeof(compactUrl)) &&
+            manifestGet(_update.manifest, "compact_checksum", compactChecksum, sizeof(compactChecksum)) &&
+            manifestGet(_update.manifest, "compact_size", compactSize, sizeof(compactSize)) &&
+            POTASha256::isHexDigest(compactChecksum)) {
+            if (!dataBudgetAllows(strtoul(compactSize, nullptr, 10) + POTA_TLS_HANDSHAKE_BYTES, false))
+                return POTAError::DATA_BUDGET_EXCEEDED;
+            Serial.println("💸 Downloading compact image");
+            _usage.downloads++;
+            POTAError err = streamImage(compactUrl, compactChecksum);
+            if (err != POTAError::SUCCESS) return err;
+            return completeUpdate();
+        }
+#endif
+        // Without a signed size only the streamed path can judge the image (by its Content-Length)
+        if (!_update.size && !POTASha256::isHexDigest(_update.checksum)) {
+            Serial.println("💸 Image size unknown, cannot fit it to the data budget");
+            return POTAError::DATA_BUDGET_EXCEEDED;
+        }
+        if (!dataBudgetAllows(_update.size + POTA_TLS_HANDSHAKE_BYTES, true)) {
+            Serial.println("💸 Data budget too tight for a full image, deferring");
+            return POTAError::DATA_BUDGET_EXCEEDED;
+        }
+    }
+
+    // Signed chunk hashes let a corrupted region be fetched again on its own
+    loadChunkHashes();
+    _usage.downloads++;
+    POTAError err = performOTA(_update.url);
+    freeChunkHashes();
+    return err;
+}
+
+bool POTA::prepareUpdate(POTAError& result) {
+    _deferred = false;
+    _retryDue = false;
+    result = POTAError::SUCCESS;
+
+    // Already downloaded and waiting for activation
+    if (_sink->isLocal() && _staged && POTASha256::isHexDigest(_update.checksum) && strcasecmp(_update.checksum, _stagedChecksum) == 0) {
+        Serial.println("📦 Update already staged");
+        return false;
+    }
+
+#if defined(ESP32) || defined(ESP8266)
+    // Nothing to do if the advertised image is the one running (e.g. after a rollback)
+    if (_sink->isLocal() && POTASha256::isHexDigest(_update.checksum) && hashRunningImage() == POTAError::SUCCESS &&
+        strcasecmp(_update.checksum, _runningChecksum) == 0) {
+        Serial.println("✅ Advertised firmware is already running");
+        result = POTAError::ALREADY_RUNNING;
+        return false;
+    }
+#endif
+
+    // Reject images that cannot fit or run before any byte is transferred
+    result = preflightUpdate(_update);
+    if (result != POTAError::SUCCESS) return false;
+
+    // Do not start a transfer the link is too weak to carry
+    if (!linkAcceptable(0)) {
+        result = deferUpdate();
+        return false;
+    }
+
+    // The download overwrites the slot a staged image waits in
+    if (_sink->isLocal()) dropStagedUpdate();
+    return true;
+}
+
+void POTA::setAllowPlainHttp(bool enabled) {
+    _allowPlainHttp = enabled;
+}
+
+void POTA::setTimeFromServer(bool enabled) {
+    _timeFromServer = enabled;
+}
+
+const POTAStats& POTA::getStats() const {
+    return _stats;
+}
+
+void POTA::getProgress(uint32_t& received, uint32_t& total) const {
+    received = _progressBytes;
+    total = _progressTotal;
+}
+
+void POTA::setDownloadRateLimit(uint32_t bytesPerSecond) {
+    _rateLimitBps = bytesPerSecond;
+}
+
+uint32_t POTA::getDownloadRateLimit() const {
+    return _rateLimitBps;
+}
+
+// -------------------- Cancel / Pause --------------------
+// Plain flag stores only: callable from any task, the download loops poll them
+bool POTA::cancel() {
+    if (!_transferActive) return false;
+    _cancelRequested = true;
+    _holdTransfer = true;
+    return true;
+}
+
+bool POTA::pause() {
+    if (!_transferActive) return false;
+    _pauseRequested = true;
+    _holdTransfer = true;
+    return true;
+}
+
+void POTA::resume() {
+    _pauseRequested = false;
+    _holdTransfer = _cancelRequested;
+}
+
+bool POTA::isPaused() const {
+    return _pauseRequested;
+}
+
+bool POTA::waitWhilePaused() {
+    if (_pauseRequested && !_cancelRequested) {
+        Serial.println("⏸️ Download paused");
+        while (_pauseRequested && !_cancelRequested) idle(POTA_THROTTLE_SLICE_MS);
+        if (!_cancelRequested) Serial.println("▶️ Download resumed");
+    }
+    if (_cancelRequested) {
+        Serial.println("⏹️ Download cancelled");
+        return false;
+    }
+    _holdTransfer = false;
+    return true;
+}
+
+void POTA::loop() {
+#if defined(ESP32)
+    if (_seederActive) serveSeeder();
+    refreshDnsIfDue();
+#endif
+
+    // Judge freshly installed firmware once its validation window closes
+    if (_canaryState == POTACanaryState::VALIDATING && (int32_t)(millis() - _canaryEndsAt) >= 0) evaluateCanary();
+
+    // Flag a deferred update for retry once the link has recovered; the application
+    // starts it (retryDeferredUpdate()), so the download and reboot happen when it chooses
+    if (_deferred && (int32_t)(millis() - _deferRetryAt) >= 0 && WiFi.status() == WL_CONNECTED) {
+        int32_t rssi = WiFi.RSSI();
+        if (rssi >= _linkPolicy.minRssi && rssi >= _deferredRssi) {
+            Serial.println("📶 Link recovered, deferred update ready to retry");
+            _deferred = false;
+            _retryDue = true;
+        } else {
+            _deferRetryAt = millis() + POTA_LINK_RETRY_MS;
+        }
+    }
+
+    // Activate a staged update once the maintenance window opens
+    if (_staged && inMaintenanceWindow()) {
+        Serial.println("🛠️ Maintenance window open, applying staged update");
+        applyStagedUpdate();
+    }
+}
+
+// -------------------- Staged Updates --------------------
+// Persisted so a staged image survives resets until it is applied
+struct POTAStagedRecord {
+    char checksum[POTA_SHA256_HEX_SIZE];    // Signed checksum of the staged image
+    char version[32];                       // Its version
+    char fromVersion[32];                   // Firmware that staged it; any other discards the record
+#if defined(ESP32)
+    uint32_t partition;                     // Address of the slot holding the image
+#elif defined(ESP8266)
+    eboot_command command;                  // Bootloader copy command held back until apply
+#endif
+};
+
+void POTA::setStagedUpdates(bool enabled) {
+    _stageUpdates = enabled;
+}
+
+void POTA::setMaintenanceWindow(int8_t startHour, int8_t endHour) {
+    if (startHour < 0 || startHour > 23 || endHour < 0 || endHour > 23) {
+        _windowStart = _windowEnd = -1; // Disabled
+        return;
+    }
+    _windowStart = startHour;
+    _windowEnd = endHour;
+}
+
+bool POTA::hasStagedUpdate() const {
+    return _staged;
+}
+
+bool POTA::inMaintenanceWindow() const {
+    if (_windowStart < 0) return false;
+    time_t now = time(nullptr);
+    if (now < 1609459200) return false; // Clock not set (before 2021), never guess
+
+    struct tm local;
+    localtime_r(&now, &local);
+    int hour = local.tm_hour;
+    if (_windowStart == _windowEnd) return true; // Whole day
+    if (_windowStart < _windowEnd) return hour >= _windowStart && hour < _windowEnd;
+    return hour >= _windowStart || hour < _windowEnd; // Window wraps past midnight
+}
+
+POTAError POTA::completeUpdate() {
+    if (!_sink->isLocal()) {
+        Serial.println("✅ Image delivered to the update sink");
+        return POTAError::SUCCESS;
+    }
+#if defined(ESP32)
+    // Images written straight to a partition (multicast) have not touched the boot selection yet
+    const esp_partition_t* written = _writtenPartition;
+    _writtenPartition = nullptr;
+    if (written && !_stageUpdates && esp_ota_set_boot_partition(written) != ESP_OK)
+        return POTAError::OTA_APPLY_FAILED;
+#endif
+    if (!_stageUpdates) return activateUpdate();
+
+    // Keep booting the running firmware until applyStagedUpdate()
+#if defined(ESP32)
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    const esp_partition_t* next = written ? written : esp_ota_get_boot_partition();
+    if (!next || next == running) return POTAError::OTA_APPLY_FAILED;
+    if (!written && esp_ota_set_boot_partition(running) != ESP_OK) return POTAError::OTA_APPLY_FAILED;
+    _stagedPartition = next;
+#elif defined(ESP8266)
+    if (eboot_command_read(&_stagedCommand) != 0) return POTAError::OTA_APPLY_FAILED;
+    eboot_command_clear();
+#endif
+    // Opta: the image stays decompressed in QSPI; the bootloader is armed on apply
+
+    _staged = true;
+    strncpy(_stagedChecksum, _update.checksum, sizeof(_stagedChecksum) - 1);
+    _stagedChecksum[sizeof(_stagedChecksum) - 1] = '\0';
+
+    POTAStagedRecord record = {};
+    strncpy(record.checksum, _stagedChecksum, sizeof(record.checksum) - 1);
+    strncpy(record.version, _update.version, sizeof(record.version) - 1);
+    strncpy(record.fromVersion, _firmwareVersion, sizeof(record.fromVersion) - 1);
+#if defined(ESP32)
+    record.partition = _stagedPartition->address;
+#elif defined(ESP8266)
+    record.command = _stagedCommand;
+#endif
+    if (!POTAStore::save("staged", &record, sizeof(record))) {
+        Serial.println("⚠️ Staged update not persisted, it is lost on reset");
+    }
+    Serial.println("📦 Update staged, waiting for applyStagedUpdate()");
+    return POTAError::SUCCESS;
+}
+
+void POTA::restoreStagedUpdate() {
+    POTAStagedRecord record;
+    if (!POTAStore::load("staged", &record, sizeof(record))) return;
+    record.checksum[sizeof(record.checksum) - 1] = '\0';
+    record.fromVersion[sizeof(record.fromVersion) - 1] = '\0';
+
+    // Applied, or replaced by other firmware since: the slot no longer holds it
+    bool valid = strcmp(record.fromVersion, _firmwareVersion) == 0 && POTASha256::isHexDigest(record.checksum);
+#if defined(ESP32)
+    const esp_partition_t* next = esp_ota_get_next_update_partition(nullptr);
+    esp_app_desc_t desc;
+    valid = valid && next && next->address == record.partition && next != esp_ota_get_running_partition() &&
+            esp_ota_get_partition_description(next, &desc) == ESP_OK;
+    if (valid) _stagedPartition = next;
+#elif defined(ESP8266)
+    valid = valid && record.command.action == ACTION_COPY_RAW;
+    if (valid) _stagedCommand = record.command;
+#elif defined(ARDUINO_OPTA)
+    FILE* image = nullptr;
+    valid = valid && optaBegin() == POTAError::SUCCESS && (image = fopen(POTA_OPTA_UPDATE_FILE, "rb")) != nullptr;
+    if (image) fclose(image);
+#endif
+    if (!valid) {
+        POTAStore::remove("staged");
+        return;
+    }
+
+    _staged = true;
+    strncpy(_stagedChecksum, record.checksum, sizeof(_stagedChecksum) - 1);
+    _stagedChecksum[sizeof(_stagedChecksum) - 1] = '\0';
+    strncpy(_update.version, record.version, sizeof(_update.version) - 1); // Reported by the canary
+    _update.version[sizeof(_update.version) - 1] = '\0';
+    Serial.print("📦 Staged update restored: ");
+    Serial.println(_update.version);
+}
+
+void POTA::dropStagedUpdate() {
+    if (!_staged) return;
+    _staged = false;
+    _stagedChecksum[0] = '\0';
+    POTAStore::remove("staged");
+}
 
-    char otaUrl[256];
-    POTAError err = checkOTAUpdate(otaUrl, sizeof(otaUrl));
+POTAError POTA::applyStagedUpdate() {
+    if (!_staged) return POTAError::NO_STAGED_UPDATE;
+#if defined(ESP32)
+    if (esp_ota_set_boot_partition(_stagedPartition) != ESP_OK) return POTAError::OTA_APPLY_FAILED;
+#elif defined(ESP8266)
+    eboot_command_write(&_stagedCommand);
+#elif defined(ARDUINO_OPTA)
+    POTAError err = optaBegin(); // Not mounted yet when the image was staged before a reset
     if (err != POTAError::SUCCESS) return err;
+#endif
+    dropStagedUpdate();
+    return activateUpdate();
+}
 
-    return performOTA(otaUrl);
+POTAError POTA::activateUpdate() {
+#if defined(ARDUINO_OPTA)
+    Serial.println("⚡ Applying OTA update...");
+    if (optaOta().update() != Arduino_Portenta_OTA::Error::None) return POTAError::OTA_APPLY_FAILED;
+#endif
+    saveCanaryBaseline();
+    Serial.println("✅ OTA update completed. Restarting...");
+    restartDevice();
+    return POTAError::SUCCESS;
 }
 
 // -------------------- Internal Helpers --------------------
+static bool parseUrl(const char* url, bool& secure, char* host, size_t hostSize,
+                     uint16_t& port, const char*& path);
+static size_t updateCapacity();
+
+// Look up `key` in a signed manifest of the form "key=value;key=value"
+static bool manifestGet(const char* manifest, const char* key, char* out, size_t outSize) {
+    size_t keyLen = strlen(key);
+    const char* p = manifest;
+    while (p && *p) {
+        const char* end = strchr(p, ';');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len > keyLen && p[keyLen] == '=' && strncmp(p, key, keyLen) == 0) {
+            size_t valueLen = len - keyLen - 1;
+            if (valueLen >= outSize) return false;
+            memcpy(out, p + keyLen + 1, valueLen);
+            out[valueLen] = '\0';
+            return true;
+        }
+        p = end ? end + 1 : nullptr;
+    }
+    return false;
+}
+
+// Firmware build time (__DATE__ __TIME__, taken as UTC): no genuine response can be older
+static time_t buildTime() {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    static const char date[] = __DATE__;  // "Mmm dd yyyy"
+    static const char clock[] = __TIME__; // "hh:mm:ss"
+    int month = 0;
+    while (month < 11 && strncmp(months + month * 3, date, 3) != 0) ++month;
+    int day = atoi(date + 4);
+    int year = atoi(date + 7);
+
+    // Days since 1970-01-01 (days-from-civil, proleptic Gregorian)
+    int y = year - (month < 2);
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int mp = (month + 10) % 12;  // March-based month, `month` is 0-based
+    int doy = (153 * mp + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = (long)era * 146097 + doe - 719468;
+
+    return (time_t)days * 86400 + atoi(clock) * 3600 + atoi(clock + 3) * 60 + atoi(clock + 6);
+}
+
 POTAError POTA::generateServerToken(bool update,
                                     const char* version,
                                     const char* url,
@@ -171,80 +795,127 @@ POTAError POTA::generateServerToken(bool update,
                                     const char* protocol_version,
                                     const char* notes,
                                     const char* timestamp,
+                                    const char* manifest,
                                     const char* secret,
                                     char* outToken, size_t outTokenSize)
 {
     if (!secret) return POTAError::PARAMETER_INVALID_SECRET;
     if (!outToken || outTokenSize < 65) return POTAError::PARAMETER_INVALID_OUTPUT;
 
-    char message[512];
-    int n = snprintf(message, sizeof(message), "%s:%s:%s:%s:%s:%s:%s",
-                     update ? "true" : "false",
-                     version ? version : "",
-                     url ? url : "",
-                     checksum ? checksum : "",
-                     protocol_version ? protocol_version : "",
-                     notes ? notes : "",
-                     timestamp ? timestamp : "");
-    if (n < 0 || n >= (int)sizeof(message)) return POTAError::TOKEN_GENERATION_FAILED;
-
+    // "update:version:url:checksum:protocol:notes:timestamp", plus ":manifest" when present;
+    // fed field by field, so long release notes need no message buffer
+    const char* fields[] = {
+        update ? "true" : "false",
+        version ? version : "",
+        url ? url : "",
+        checksum ? checksum : "",
+        protocol_version ? protocol_version : "",
+        notes ? notes : "",
+        timestamp ? timestamp : "",
+    };
+    POTAHmacSha256 mac;
+    mac.begin((const uint8_t*)secret, strlen(secret));
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        if (i > 0) mac.update((const uint8_t*)":", 1);
+        mac.update((const uint8_t*)fields[i], strlen(fields[i]));
+    }
+    if (manifest && manifest[0]) {
+        mac.update((const uint8_t*)":", 1);
+        mac.update((const uint8_t*)manifest, strlen(manifest));
+    }
     unsigned char hmac[32]; // SHA256 produce 32 byte
-    
-    #if defined(ESP32) || defined(ARDUINO_OPTA)
-        mbedtls_md_context_t ctx;
-        const mbedtls_md_info_t* info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
-        mbedtls_md_init(&ctx);
-        mbedtls_md_setup(&ctx, info, 1);
-        mbedtls_md_hmac_starts(&ctx, (const unsigned char*)secret, strlen(secret));
-        mbedtls_md_hmac_update(&ctx, (const unsigned char*)message, strlen(message));
-        mbedtls_md_hmac_finish(&ctx, hmac);
-        mbedtls_md_free(&ctx);
-    #elif defined(ESP8266)
-        br_hmac_key_context kc;
-        br_hmac_context ctx;
-        br_hmac_key_init(&kc, &br_sha256_vtable, secret, strlen(secret));
-        br_hmac_init(&ctx, &kc, 32);  // 32 = output size SHA256
-        br_hmac_update(&ctx, message, strlen(message));
-        br_hmac_out(&ctx, hmac);
-    #endif
+    mac.finish(hmac);
 
-    static const char hexChars[] = "0123456789abcdef";
-    for (int i = 0; i < 32; ++i) {
-        outToken[i*2]     = hexChars[(hmac[i] >> 4) & 0x0F];
-        outToken[i*2 + 1] = hexChars[hmac[i] & 0x0F];
-    }
-    outToken[64] = '\0';
+    POTASha256::toHex(hmac, sizeof(hmac), outToken);
     return POTAError::SUCCESS;
 }
 
-POTAError POTA::checkOTAUpdate(char* outOTAUrl, size_t outOTAUrlSize) {
+POTAError POTA::checkForUpdate(POTAUpdateInfo& info) {
+    if (coroutineActive()) return POTAError::OPERATION_IN_PROGRESS;
+    POTAPerformanceScope profile(_performanceProfile, _stats);
+    POTAError err = sendUpdateCheck(info);
+    if (err != POTAError::SUCCESS) return err;
+
+    // Wait until server starts responding
+    while (_client->connected() && !_client->available()) delay(10);
+    return receiveUpdateCheck(info);
+}
+
+POTAError POTA::sendUpdateCheck(POTAUpdateInfo& info) {
     // Validate inputs
     if (!_client) return POTAError::CLIENT_NOT_INITIALIZED;
-    if (!outOTAUrl || outOTAUrlSize == 0) return POTAError::PARAMETER_INVALID_OUTPUT;
-    outOTAUrl[0] = '\0';
+    info = POTAUpdateInfo();
 
+    // Metered link: a check costs a handshake plus a small request and response
+    loadUsage();
+    if (!dataBudgetAllows(POTA_TLS_HANDSHAKE_BYTES + 2 * POTA_RESPONSE_BUFFER_SIZE, false)) {
+        Serial.println("💸 Data budget used up, skipping update check");
+        return POTAError::DATA_BUDGET_EXCEEDED;
+    }
+
+    // Trust the generated root bundle; only the issuing root is decoded per handshake
     #if defined(ESP32)
-        // Set Root CA for secure TLS connection (ESP32 only)
-        _client->setCACert(root_ca);
+        #if ESP_ARDUINO_VERSION_MAJOR >= 3
+            _client->setCACertBundle(pota_ca_bundle, sizeof(pota_ca_bundle));
+        #else
+            _client->setCACertBundle(pota_ca_bundle);
+        #endif
     #endif
     
     #if defined(ESP8266)
-        static X509List cert(root_ca);
-        _client->setTrustAnchors(&cert);
+        static POTACertStore certStore;
+        _client->setCertStore(&certStore);
+        configureTlsBuffers(API_HOST, false);
+        // Validate certificates against the build date until the clock is known
+        if (_timeFromServer) {
+            time_t now = time(nullptr);
+            _client->setX509Time(now > buildTime() ? now : buildTime());
+        }
     #endif
     
     #if defined(ARDUINO_OPTA)
-        _client->appendCustomCACert(root_ca);
+        // WiFiSSLClient only takes PEM roots and has no subject lookup: the bundle is appended
+        // once and the client parses every appended root on each handshake
+        static bool bundleAppended = false;
+        if (!bundleAppended) {
+            for (size_t i = 0; i < POTA_CA_BUNDLE_COUNT; ++i) _client->appendCustomCACert(pota_ca_pem[i]);
+            bundleAppended = true;
+        }
     #endif
 
     // Try to connect to the OTA server
-    if (!_client->connect(API_HOST, 443)) return POTAError::CONNECTION_FAILED;
+    #if defined(ESP32)
+        // Connect to the cached address; SNI and certificate checks still use API_HOST
+        IPAddress apiAddress;
+        bool resolved = resolveApiHost(apiAddress);
+        bool connected = resolved && _client->connect(apiAddress, 443, API_HOST, nullptr, nullptr, nullptr);
+        if (!connected && resolved) {
+            _dnsValid = false; // Stale address, fall back to a fresh lookup
+            connected = _client->connect(API_HOST, 443);
+        }
+        if (!connected) return POTAError::CONNECTION_FAILED;
+    #else
+        // These clients only send SNI and check the certificate name when given a hostname
+        if (!_client->connect(API_HOST, 443)) {
+            #if defined(ESP8266)
+                if (_mflnSupported) {
+                    // Small buffers may no longer fit the server; probe again next time
+                    _mflnProbed = false;
+                    POTAStore::remove("mfln");
+                }
+            #endif
+            return POTAError::CONNECTION_FAILED;
+        }
+    #endif
     Serial.println("🔗 Connected to server");
+    chargeHandshake(false);
 
     // Single buffer used for both request JSON body and server response
-    char buffer[1024];
+    char buffer[POTA_RESPONSE_BUFFER_SIZE];
 
     // --- Build JSON request body ---
+    char canary[128];
+    canaryReport(canary, sizeof(canary));
     int bodyLen = snprintf(buffer, sizeof(buffer),
              "{"
              "\"device_id\":\"%s\","
@@ -252,12 +923,14 @@ POTAError POTA::checkOTAUpdate(char* outOTAUrl, size_t outOTAUrlSize) {
              "\"firmware_version\":\"%s\","
              "\"protocol_version\":\"%s\","
              "\"auth_token\":\"%s\""
+             "%s"
              "}",
              getSecureMACAddress().c_str(),
              _deviceType,
              _firmwareVersion,
              POTA_PROTOCOL_VERSION,
-             _authToken);
+             _authToken,
+             canary);
 
     // Check for buffer overflow during request construction
     if (bodyLen < 0 || bodyLen >= (int)sizeof(buffer)) {
@@ -267,28 +940,39 @@ POTAError POTA::checkOTAUpdate(char* outOTAUrl, size_t outOTAUrlSize) {
     }
 
     // --- Send HTTP POST request ---
-    _client->println("POST " CHECK_UPDATE_API " HTTP/1.1");
-    _client->println("Host: " API_HOST);
-    _client->println("Content-Type: application/json");
-    _client->print("Content-Length: ");
-    _client->println(bodyLen);
-    _client->println("Connection: close");
-    _client->println();
-    _client->println(buffer); // Send JSON body
+    size_t traffic = 0; // Request and response bytes, for the data budget
+    traffic += _client->println("POST " CHECK_UPDATE_API " HTTP/1.1");
+    traffic += _client->println("Host: " API_HOST);
+    traffic += _client->println("Content-Type: application/json");
+    traffic += _client->print("Content-Length: ");
+    traffic += _client->println(bodyLen);
+    traffic += _client->println("Connection: close");
+    traffic += _client->println();
+    traffic += _client->println(buffer); // Send JSON body
+    _checkTraffic = traffic;
+    _checkCanary = canary[0] != '\0';
+    return POTAError::SUCCESS;
+}
 
-    // Wait until server starts responding
-    while (_client->connected() && !_client->available()) delay(10);
+POTAError POTA::receiveUpdateCheck(POTAUpdateInfo& info) {
+    char buffer[POTA_RESPONSE_BUFFER_SIZE];
+    size_t traffic = _checkTraffic;
 
     // --- Skip HTTP headers ---
     while (_client->available()) {
         char line[128];
         size_t len = _client->readBytesUntil('\n', line, sizeof(line) - 1);
         line[len] = '\0';
+        traffic += len + 1;
         if (strcmp(line, "\r") == 0) break; // End of headers
     }
 
     // --- Read HTTP response body into same buffer ---
     size_t len = _client->readBytes(buffer, sizeof(buffer) - 1);
+    traffic += len;
+    _usage.checks++;
+    _usage.checkBytes += traffic;
+    saveUsage();
     
     // Check for buffer overflow during response read
     if (len >= sizeof(buffer) - 1) {
@@ -302,9 +986,44 @@ POTAError POTA::checkOTAUpdate(char* outOTAUrl, size_t outOTAUrlSize) {
     _client->stop();
     Serial.println("🔌 Disconnected from server");
 
-    // --- Parse JSON response ---
-    StaticJsonDocument<1024> doc;
-    DeserializationError error = deserializeJson(doc, buffer);
+    // --- Parse JSON response and verify the server token ---
+    long timestampValue = 0;
+    POTAError err = parseSignedUpdate(buffer, info, timestampValue);
+
+    // The server has the canary outcome now
+    if (err != POTAError::JSON_PARSE_FAILED && _checkCanary) {
+        POTAStore::remove("canary");
+        _canaryState = POTACanaryState::NONE;
+    }
+    if (err != POTAError::SUCCESS) return err;
+
+    // --- Bootstrap the clock from the signed timestamp ---
+    if (_timeFromServer) {
+        err = applyServerTime(timestampValue);
+        if (err != POTAError::SUCCESS) return err;
+    }
+
+    // --- If update is available and URL is valid ---
+    // Plain-HTTP mirrors are opt-in and need a checksum to verify the stream against
+    bool urlValid = strncmp(info.url, "https://" API_HOST, strlen("https://" API_HOST)) == 0 ||
+                    (_allowPlainHttp && strncmp(info.url, "http://", 7) == 0 && POTASha256::isHexDigest(info.checksum));
+    if (info.available && urlValid) {
+        Serial.print("⬆️ New firmware version available: ");
+        Serial.println(info.version);
+        Serial.print("📝 Notes: ");
+        Serial.println(info.notes);
+        return POTAError::SUCCESS;
+    }
+
+    // Otherwise, no update available
+    info = POTAUpdateInfo();
+    return POTAError::NO_UPDATE_AVAILABLE;
+}
+
+POTAError POTA::parseSignedUpdate(char* json, POTAUpdateInfo& info, long& timestamp) {
+    // Zero-copy parse: strings stay in `json`, the document only holds the tree
+    StaticJsonDocument<512> doc;
+    DeserializationError error = deserializeJson(doc, json);
     if (error) {
         Serial.print("❌ JSON parse failed: ");
         Serial.println(error.c_str());
@@ -318,14 +1037,14 @@ POTAError POTA::checkOTAUpdate(char* outOTAUrl, size_t outOTAUrlSize) {
     const char* checksum = doc["checksum"] | "";
     const char* protocol_version = doc["protocol_version"] | "";
     const char* notes = doc["notes"] | "";
+    const char* manifest = doc["manifest"] | "";
     const char* server_token = doc["server_token"] | "";
     const char* errorMsg = doc["error"] | "";
-    long timestampValue = doc["timestamp"] | 0;
-    
+    timestamp = doc["timestamp"] | 0;
 
     // Convert timestamp into string for token generation
     char timestampStr[32];
-    snprintf(timestampStr, sizeof(timestampStr), "%ld", timestampValue);
+    snprintf(timestampStr, sizeof(timestampStr), "%ld", timestamp);
 
     if (strlen(errorMsg) > 0) {
         Serial.print("❌ Server error message: ");
@@ -336,57 +1055,139 @@ POTAError POTA::checkOTAUpdate(char* outOTAUrl, size_t outOTAUrlSize) {
     // --- Verify server token for security ---
     char expectedToken[65];
     POTAError err = generateServerToken(update, version, url, checksum,
-                                        protocol_version, notes, timestampStr,
+                                        protocol_version, notes, timestampStr, manifest,
                                         _serverSecret, expectedToken, sizeof(expectedToken));
     if (err != POTAError::SUCCESS) return err;
 
     // Compare expected vs received token
     if (strcmp(expectedToken, server_token) != 0) return POTAError::TOKEN_MISMATCH;
+    if (!update) return POTAError::SUCCESS;
 
-    // --- If update is available and URL is valid ---
-    if (update && strncmp(url, "https://" API_HOST, strlen("https://" API_HOST)) == 0) {
-        Serial.print("⬆️ New firmware version available: ");
-        Serial.println(version);
-        Serial.print("📝 Notes: ");
-        Serial.println(notes);
-        strncpy(outOTAUrl, url, outOTAUrlSize - 1);
-        outOTAUrl[outOTAUrlSize - 1] = '\0'; // Ensure null-termination
-        return POTAError::SUCCESS;
+    // --- Keep the signed fields ---
+    if (strlen(url) >= sizeof(info.url) || strlen(manifest) >= sizeof(info.manifest))
+        return POTAError::BUFFER_OVERFLOW_RESPONSE;
+    strcpy(info.url, url);
+    strcpy(info.manifest, manifest);
+    strncpy(info.version, version, sizeof(info.version) - 1);
+    strncpy(info.checksum, checksum, sizeof(info.checksum) - 1);
+
+    // Bounded excerpt, cut on a UTF-8 character boundary
+    size_t notesLen = strlen(notes);
+    if (notesLen >= sizeof(info.notes)) {
+        notesLen = sizeof(info.notes) - 1;
+        while (notesLen > 0 && ((uint8_t)notes[notesLen] & 0xC0) == 0x80) --notesLen;
     }
+    memcpy(info.notes, notes, notesLen);
+    info.notes[notesLen] = '\0';
 
-    // Otherwise, no update available
-    return POTAError::NO_UPDATE_AVAILABLE;
+    char sizeStr[16];
+    if (manifestGet(manifest, "size", sizeStr, sizeof(sizeStr))) info.size = strtoul(sizeStr, nullptr, 10);
+    info.available = true;
+    return POTAError::SUCCESS;
 }
 
 POTAError POTA::performOTA(const char* OTA_file_url) {
     // Validate OTA URL
     if (!OTA_file_url || strlen(OTA_file_url) == 0) 
         return POTAError::PARAMETER_INVALID_OTA_URL;
+    beginDownload();
+
+    // A cancelled streamed transfer of this image picks up where it stopped
+    bool resume = _partialChecksum[0] && strcasecmp(_partialChecksum, _update.checksum) == 0;
+    if (!resume) discardPartial();
 
 #if defined(ESP32)
+    // Multicast carousel first; any failure falls through to a plain download
+    if (_mcastEnabled && !resume && _sink->isLocal()) {
+        POTAError mcastErr = receiveMulticast(OTA_file_url);
+        if (mcastErr == POTAError::SUCCESS) return completeUpdate();
+        if (mcastErr == POTAError::DOWNLOAD_CANCELLED) return mcastErr;
+        Serial.print("⚠️ Multicast receive failed (");
+        Serial.print(errorToString(mcastErr));
+        Serial.println("), downloading directly");
+    }
+#endif
+
+    // Signed mirror list: fastest source first, failing over with Range resume
+    char mirrors[POTA_MANIFEST_SIZE];
+    if (manifestGet(_update.manifest, "mirrors", mirrors, sizeof(mirrors)) && POTASha256::isHexDigest(_update.checksum)) {
+        POTAError err = downloadFromMirrors(OTA_file_url, mirrors);
+        if (err != POTAError::SUCCESS) return err;
+        return completeUpdate();
+    }
+
+    // Plain-HTTP mirror: stream, hash and only activate a matching image
+    if (strncmp(OTA_file_url, "http://", 7) == 0) {
+        if (!_allowPlainHttp) return POTAError::PARAMETER_INVALID_OTA_URL;
+        Serial.println("⬇️ Streaming firmware from HTTP mirror...");
+        POTAError err = streamImage(OTA_file_url, _update.checksum);
+        if (err != POTAError::SUCCESS) return err;
+        return completeUpdate();
+    }
+
+    // The library paths below can neither continue a partial image, verify chunks, write to a
+    // sink nor check an image of unknown size against the data budget before it starts
+    if (resume || _chunkHashes || _sink != &_otaSink || (_dataBudget && !_update.size)) {
+        Serial.println(resume ? "⏯️ Resuming cancelled download..." : "⬇️ Streaming firmware...");
+        POTAError err = streamImage(OTA_file_url, _update.checksum);
+        if (err != POTAError::SUCCESS) return err;
+        return completeUpdate();
+    }
+
+#if defined(ESP32) && ESP_ARDUINO_VERSION_MAJOR < 3
+    // esp_https_ota on core 2.x only takes a single PEM root; the streamed client carries the bundle
+    Serial.println("⬇️ Streaming firmware...");
+    POTAError err = streamImage(OTA_file_url, _update.checksum);
+    if (err != POTAError::SUCCESS) return err;
+    return completeUpdate();
+
+#elif defined(ESP32)
     // ESP32 OTA using esp_https_ota
     Serial.println("🔍 Checking for OTA update...");
     esp_http_client_config_t http_config = {
         .url = OTA_file_url,
-        .cert_pem = root_ca,
         .timeout_ms = 10000,
+        .crt_bundle_attach = esp_crt_bundle_attach,
     };
-    
-    #if ESP_IDF_VERSION_MAJOR < 5
-        // ESP-IDF v4.x → core Arduino ESP32 2.x
-        esp_err_t ret = esp_https_ota(&http_config);
-    #else
-        // ESP-IDF v5.x → core Arduino ESP32 3.x
-        esp_https_ota_config_t ota_config = {
-            .http_config = &http_config,
-        };
-        esp_err_t ret = esp_https_ota(&ota_config);
-    #endif
+    esp_https_ota_config_t ota_config = {
+        .http_config = &http_config,
+    };
+    esp_crt_bundle_set(pota_ca_bundle, sizeof(pota_ca_bundle));
+
+    // Advanced API, so the transfer can be measured
+    unsigned long start = millis();
+    esp_https_ota_handle_t handle = nullptr;
+    esp_err_t ret = esp_https_ota_begin(&ota_config, &handle);
+    if (ret == ESP_OK) {
+        chargeHandshake(true);
+        // Only the response head has been read: check the announced size first
+        int imageSize = esp_https_ota_get_image_size(handle);
+        if (imageSize > 0 && (size_t)imageSize > updateCapacity()) {
+            esp_https_ota_abort(handle);
+            Serial.println("❌ Image does not fit the update partition");
+            return POTAError::IMAGE_TOO_LARGE;
+        }
+        int lastRead = 0;
+        while ((ret = esp_https_ota_perform(handle)) == ESP_ERR_HTTPS_OTA_IN_PROGRESS) {
+            int read = esp_https_ota_get_image_len_read(handle);
+            chargeDownload(read - lastRead);
+            lastRead = read;
+            if (_holdTransfer && !waitWhilePaused()) break;
+            if (linkTooSlow(read, imageSize > 0 ? imageSize : 0, start)) break;
+        }
+        if (ret == ESP_OK && !esp_https_ota_is_complete_data_received(handle)) ret = ESP_FAIL;
+        _stats.downloadSecure = true;
+        recordDownload(esp_https_ota_get_image_len_read(handle), millis() - start);
+        if (_cancelRequested || _linkRejected) {
+            esp_https_ota_abort(handle); // Closes the connection, the boot partition is untouched
+            return _cancelRequested ? POTAError::DOWNLOAD_CANCELLED : deferUpdate();
+        }
+        if (ret == ESP_OK) ret = esp_https_ota_finish(handle);
+        else esp_https_ota_abort(handle);
+    }
     
     if (ret == ESP_OK) {
-        Serial.println("✅ OTA update completed. Restarting...");
-        esp_restart();
-        return POTAError::SUCCESS;
+        return completeUpdate();
     } else {
         Serial.printf("❌ OTA failed. Error: %s\n", esp_err_to_name(ret));
         return POTAError::OTA_FAILED;
@@ -395,29 +1196,60 @@ POTAError POTA::performOTA(const char* OTA_file_url) {
 #elif defined(ESP8266)
     // ESP8266 OTA using ESP8266httpUpdate
     Serial.println("🔍 Checking for OTA update...");
+    unsigned long start = millis();
+    uint32_t received = 0;
+    ESPhttpUpdate.onProgress([this, &received, start](int current, int total) {
+        chargeDownload(current - received);
+        received = current;
+        // Stopping the client makes the updater fail on the closed stream
+        if (_holdTransfer && !waitWhilePaused()) _client->stop();
+        else if (linkTooSlow(current, total > 0 ? total : 0, start)) _client->stop();
+    });
+    ESPhttpUpdate.rebootOnUpdate(false);
+    char host[128];
+    bool secure;
+    uint16_t port;
+    const char* path;
+    if (parseUrl(OTA_file_url, secure, host, sizeof(host), port, path)) configureTlsBuffers(host, true);
+    chargeHandshake(true);
     t_httpUpdate_return ret = ESPhttpUpdate.update(*_client, String(OTA_file_url));
+    _stats.downloadSecure = true;
+    recordDownload(received, millis() - start);
+    if (_cancelRequested) return POTAError::DOWNLOAD_CANCELLED;
+    if (_linkRejected) return deferUpdate();
     if (ret == HTTP_UPDATE_FAILED) {
         Serial.printf("❌ OTA failed. Error (%d): %s\n", ESPhttpUpdate.getLastError(), ESPhttpUpdate.getLastErrorString().c_str());
         return POTAError::OTA_FAILED;
     }
-    Serial.println("✅ OTA update completed. Restarting...");
-    return POTAError::SUCCESS;
+    if (ret == HTTP_UPDATE_NO_UPDATES) return POTAError::NO_UPDATE_AVAILABLE;
+    return completeUpdate();
 
 #elif defined(ARDUINO_OPTA)
     // Portenta OTA using Arduino_Portenta_OTA
     Serial.println("🔍 Checking for OTA update...");
 
     // Initialize OTA object
-    Arduino_Portenta_OTA_QSPI ota(QSPI_FLASH_FATFS_MBR, 2);
-    if (!ota.isOtaCapable()) return POTAError::OTA_NOT_CAPABLE;
+    Arduino_Portenta_OTA_QSPI& ota = optaOta();
+    POTAError beginErr = optaBegin();
+    if (beginErr != POTAError::SUCCESS) return beginErr;
 
-    Arduino_Portenta_OTA::Error err;
-    if ((err = ota.begin()) != Arduino_Portenta_OTA::Error::None) 
-        return POTAError::OTA_BEGIN_FAILED;
+    // The library download is one blocking call; rate limits and yield hooks need the streaming path
+    if ((_rateLimitBps || _yieldHook) && POTASha256::isHexDigest(_update.checksum)) {
+        Serial.println("⬇️ Streaming OTA firmware...");
+        POTAError err = streamImage(OTA_file_url, _update.checksum);
+        if (err != POTAError::SUCCESS) return err;
+        return completeUpdate();
+    }
 
-    // Download OTA firmware
+    // Download OTA firmware (a single blocking call: cancel() only applies before it starts)
+    if (_holdTransfer && !waitWhilePaused()) return POTAError::DOWNLOAD_CANCELLED;
     Serial.println("⬇️ Starting OTA firmware download...");
+    unsigned long start = millis();
     int downloaded = ota.download(OTA_file_url, true);
+    chargeHandshake(true);
+    if (downloaded > 0) chargeDownload(downloaded);
+    _stats.downloadSecure = true;
+    recordDownload(downloaded > 0 ? downloaded : 0, millis() - start);
     Serial.print("⬇️ Download result: ");
     Serial.println(downloaded);
     if (downloaded == -3011) return POTAError::OTA_WIFI_FW_MISSING;
@@ -432,19 +1264,2090 @@ POTAError POTA::performOTA(const char* OTA_file_url) {
     if (decompressed <= 0) return POTAError::OTA_DECOMPRESSION_FAILED;
     Serial.println("✅ OTA firmware decompressed successfully.");
 
-    // Apply OTA update
-    Serial.println("⚡ Applying OTA update...");
-    if ((err = ota.update()) != Arduino_Portenta_OTA::Error::None) 
-        return POTAError::OTA_APPLY_FAILED;
+    // Apply OTA update (now, or later when staged)
+    return completeUpdate();
 
-    Serial.println("✅ OTA update completed. Restarting...");
-    delay(1000);
-    ota.reset();
+#endif
+}
+
+// -------------------- Server Time --------------------
+POTAError POTA::applyServerTime(long serverTime) {
+    time_t floor = buildTime();
+    if (serverTime < floor) {
+        Serial.println("❌ Server timestamp predates this firmware");
+        return POTAError::TIMESTAMP_INVALID;
+    }
+
+    // Replay window: never go back past the newest timestamp already accepted
+    if (_lastServerTime == 0) POTAStore::load("srvtime", &_lastServerTime, sizeof(_lastServerTime));
+    if (serverTime + POTA_TIME_REPLAY_WINDOW_S < _lastServerTime) {
+        Serial.println("❌ Server timestamp is older than a previous response");
+        return POTAError::TIMESTAMP_INVALID;
+    }
+
+    // Once the clock is trusted, a stale response is a replay rather than clock error
+    time_t now = time(nullptr);
+    if (now >= floor && serverTime + POTA_TIME_REPLAY_WINDOW_S < now) {
+        Serial.println("❌ Server timestamp outside the replay window");
+        return POTAError::TIMESTAMP_INVALID;
+    }
+
+    if (serverTime > _lastServerTime) {
+        _lastServerTime = serverTime;
+        POTAStore::save("srvtime", &_lastServerTime, sizeof(_lastServerTime));
+    }
+
+    // Step the clock only when it is unset or drifted beyond the allowed skew
+    long skew = (long)(serverTime - now);
+    if (now >= floor && labs(skew) <= POTA_TIME_MAX_SKEW_S) return POTAError::SUCCESS;
+#if defined(ESP32) || defined(ESP8266)
+    struct timeval tv = { (time_t)serverTime, 0 };
+    settimeofday(&tv, nullptr);
+#elif defined(ARDUINO_OPTA)
+    set_time((time_t)serverTime);
+#endif
+    Serial.print("🕒 Clock set from server, skew was ");
+    Serial.print(now >= floor ? skew : 0);
+    Serial.println(" s");
+    return POTAError::SUCCESS;
+}
+
+// -------------------- TLS Buffers (ESP8266) --------------------
+#if defined(ESP8266)
+// BearSSL default: a full 16 KB record plus overhead in, 512 bytes out
+#define POTA_TLS_DEFAULT_BUFFERS (16384 + 325 + 512 + 85)
+
+void POTA::configureTlsBuffers(const char* host, bool bulk) {
+    uint16_t rx = bulk ? POTA_TLS_DOWNLOAD_BUFFER : POTA_TLS_CHECK_BUFFER;
+    bool supported;
+    if (strcmp(host, API_HOST) == 0) {
+        // Probe the update server once; the result is cached across reboots
+        if (!_mflnProbed) {
+            uint8_t cached = 0;
+            if (POTAStore::load("mfln", &cached, sizeof(cached))) {
+                _mflnSupported = cached == 1;
+            } else {
+                _mflnSupported = _client->probeMaxFragmentLength(API_HOST, 443, POTA_TLS_CHECK_BUFFER) &&
+                                 _client->probeMaxFragmentLength(API_HOST, 443, POTA_TLS_DOWNLOAD_BUFFER);
+                cached = _mflnSupported ? 1 : 2;
+                POTAStore::save("mfln", &cached, sizeof(cached));
+            }
+            _mflnProbed = true;
+        }
+        supported = _mflnSupported;
+    } else {
+        supported = _client->probeMaxFragmentLength(host, 443, rx);
+    }
+
+    // Without MFLN the server may send full 16 KB records
+    if (!supported) rx = 16384;
+    _client->setBufferSizes(rx, POTA_TLS_TX_BUFFER);
+    _stats.tlsBufferBytes = rx + POTA_TLS_TX_BUFFER;
+
+    Serial.print("♻️ TLS buffers ");
+    Serial.print(rx);
+    Serial.print("/");
+    Serial.print(POTA_TLS_TX_BUFFER);
+    Serial.print(" bytes, ");
+    Serial.print((long)POTA_TLS_DEFAULT_BUFFERS - (long)_stats.tlsBufferBytes);
+    Serial.println(" bytes reclaimed");
+}
+#endif
+
+// -------------------- DNS Cache --------------------
+#if defined(ESP32)
+// Last-known-good API_HOST address, kept in RTC memory across deep sleep and soft resets
+struct POTADnsRecord {
+    uint32_t magic;
+    uint32_t address;
+    uint32_t resolvedAt;  // time() in seconds when resolved
+    uint32_t check;
+};
+#define POTA_DNS_RECORD_MAGIC 0x504F4444UL // "POTD"
+RTC_NOINIT_ATTR static POTADnsRecord potaDnsRecord;
+
+// States of the background lookup started by refreshDnsIfDue()
+#define POTA_DNS_IDLE 0
+#define POTA_DNS_PENDING 1
+#define POTA_DNS_RESOLVED 2
+#define POTA_DNS_FAILED 3
+
+static uint32_t dnsRecordCheck(const POTADnsRecord& r) {
+    return r.magic ^ r.address ^ r.resolvedAt ^ 0xA5A5A5A5UL;
+}
+
+void POTA::loadDnsRecord() {
+    _dnsLoaded = true;
+    const POTADnsRecord& r = potaDnsRecord;
+    if (r.magic != POTA_DNS_RECORD_MAGIC || r.check != dnsRecordCheck(r) || r.address == 0) return;
+
+    _dnsAddress = IPAddress(r.address);
+    _dnsValid = true;
+    // Still fresh if the RTC clock shows it was resolved less than one TTL ago
+    uint32_t now = (uint32_t)time(nullptr);
+    uint32_t age = now - r.resolvedAt;
+    bool fresh = now >= r.resolvedAt && age < POTA_DNS_TTL_MS / 1000;
+    _dnsExpiresAt = millis() + (fresh ? POTA_DNS_TTL_MS - age * 1000 : 0);
+}
+
+void POTA::saveDnsRecord() {
+    POTADnsRecord r;
+    r.magic = POTA_DNS_RECORD_MAGIC;
+    r.address = (uint32_t)_dnsAddress;
+    r.resolvedAt = (uint32_t)time(nullptr);
+    r.check = dnsRecordCheck(r);
+    potaDnsRecord = r;
+}
+
+void POTA::storeDnsAddress(const IPAddress& address) {
+    _dnsAddress = address;
+    _dnsValid = true;
+    _dnsExpiresAt = millis() + POTA_DNS_TTL_MS;
+    saveDnsRecord();
+}
+
+bool POTA::refreshDns() {
+    IPAddress address;
+    unsigned long t0 = millis();
+    bool ok = WiFi.hostByName(API_HOST, address) == 1 && (uint32_t)address != 0;
+    _stats.dnsTimeMs = millis() - t0;
+    if (!ok) {
+        _dnsRetryAt = millis() + POTA_DNS_RETRY_MS;
+        return false;
+    }
+    storeDnsAddress(address);
+    return true;
+}
+
+bool POTA::resolveApiHost(IPAddress& address) {
+    if (!_dnsLoaded) loadDnsRecord();
+
+    if (_dnsValid && (long)(_dnsExpiresAt - millis()) > 0) {
+        _stats.dnsTimeMs = 0; // Cache hit
+        address = _dnsAddress;
+        return true;
+    }
+    if (refreshDns()) {
+        address = _dnsAddress;
+        return true;
+    }
+    if (_dnsValid) {
+        Serial.println("⚠️ DNS lookup failed, using last known address");
+        address = _dnsAddress;
+        return true;
+    }
+    return false;
+}
+
+// Both run in the lwIP thread: dns_gethostbyname() must not be called from the sketch task
+void POTA::dnsLookupStart(void* arg) {
+    POTA* self = static_cast<POTA*>(arg);
+    ip_addr_t address;
+    err_t err = dns_gethostbyname(API_HOST, &address, dnsLookupDone, self);
+    if (err == ERR_OK) dnsLookupDone(API_HOST, &address, self);
+    else if (err != ERR_INPROGRESS) self->_dnsLookup = POTA_DNS_FAILED;
+}
+
+void POTA::dnsLookupDone(const char* name, const ip_addr_t* address, void* arg) {
+    (void)name;
+    POTA* self = static_cast<POTA*>(arg);
+    if (address && IP_IS_V4(address) && ip4_addr_get_u32(ip_2_ip4(address)) != 0) {
+        self->_dnsLookupResult = ip4_addr_get_u32(ip_2_ip4(address));
+        self->_dnsLookup = POTA_DNS_RESOLVED;
+    } else {
+        self->_dnsLookup = POTA_DNS_FAILED;
+    }
+}
+
+void POTA::refreshDnsIfDue() {
+    // --- Collect the result of a background lookup ---
+    if (_dnsLookup == POTA_DNS_PENDING) return;
+    if (_dnsLookup == POTA_DNS_RESOLVED) storeDnsAddress(IPAddress(_dnsLookupResult));
+    else if (_dnsLookup == POTA_DNS_FAILED) _dnsRetryAt = millis() + POTA_DNS_RETRY_MS;
+    _dnsLookup = POTA_DNS_IDLE;
+
+    // --- Start one shortly before the cached address expires ---
+    if (!_dnsValid || WiFi.status() != WL_CONNECTED) return;
+    unsigned long now = millis();
+    if ((long)(_dnsExpiresAt - now) > (long)POTA_DNS_REFRESH_MARGIN_MS) return;
+    if (_dnsRetryAt != 0 && (long)(_dnsRetryAt - now) > 0) return;
+    _dnsRetryAt = 0;
+    _dnsLookup = POTA_DNS_PENDING;
+    if (tcpip_callback(dnsLookupStart, this) != ERR_OK) _dnsLookup = POTA_DNS_FAILED;
+}
+#endif
+
+// -------------------- Running Image --------------------
+#if defined(ESP32) || defined(ESP8266)
+// Persisted digest of the running image, valid while the build id matches
+struct POTARunningHash {
+    uint8_t buildId[POTA_SHA256_SIZE];
+    uint32_t size;
+    uint8_t digest[POTA_SHA256_SIZE];
+};
+
+// Read `len` bytes of the running image at `offset`
+static bool readRunningImage(uint32_t offset, uint8_t* buffer, size_t len) {
+#if defined(ESP32)
+    return esp_partition_read(esp_ota_get_running_partition(), offset, buffer, len) == ESP_OK;
+#else
+    return ESP.flashRead(offset, buffer, len); // The sketch starts at flash offset 0
+#endif
+}
+
+POTAError POTA::hashRunningImage() {
+    if (_runningImageSize > 0) return POTAError::SUCCESS;
+
+    uint32_t size = ESP.getSketchSize();
+    uint8_t buffer[POTA_STREAM_BUFFER_SIZE];
+    POTARunningHash cached;
+#if defined(ESP32)
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (!running || size == 0 || size > running->size) return POTAError::OTA_FAILED;
+
+    // The ELF hash embedded by the build identifies the image exactly
+    #if ESP_IDF_VERSION_MAJOR >= 5
+        const esp_app_desc_t* app = esp_app_get_description();
+    #else
+        const esp_app_desc_t* app = esp_ota_get_app_description();
+    #endif
+    uint8_t buildId[POTA_SHA256_SIZE];
+    memcpy(buildId, app->app_elf_sha256, sizeof(buildId));
+    char key[16];
+    snprintf(key, sizeof(key), "rh_%.12s", running->label);
+#else
+    if (size == 0) return POTAError::OTA_FAILED;
+
+    // No build hash in ESP8266 images: fingerprint size, head and tail instead
+    uint8_t buildId[POTA_SHA256_SIZE];
+    POTASha256 idSha;
+    idSha.update((const uint8_t*)&size, sizeof(size));
+    uint32_t tail = size > sizeof(buffer) ? size - sizeof(buffer) : 0;
+    if (!readRunningImage(0, buffer, sizeof(buffer) < size ? sizeof(buffer) : size)) return POTAError::OTA_FAILED;
+    idSha.update(buffer, sizeof(buffer) < size ? sizeof(buffer) : size);
+    if (!readRunningImage(tail, buffer, size - tail)) return POTAError::OTA_FAILED;
+    idSha.update(buffer, size - tail);
+    idSha.finish(buildId);
+    const char* key = "rh_sketch";
+#endif
+
+    if (POTAStore::load(key, &cached, sizeof(cached)) && cached.size == size &&
+        memcmp(cached.buildId, buildId, sizeof(buildId)) == 0) {
+        POTASha256::toHex(cached.digest, sizeof(cached.digest), _runningChecksum);
+        _runningImageSize = size;
+        return POTAError::SUCCESS;
+    }
+
+    POTASha256 sha;
+    for (uint32_t offset = 0; offset < size; ) {
+        uint32_t n = size - offset;
+        if (n > sizeof(buffer)) n = sizeof(buffer);
+        if (!readRunningImage(offset, buffer, n)) return POTAError::OTA_FAILED;
+        sha.update(buffer, n);
+        offset += n;
+        yield();
+    }
+    sha.finish(cached.digest);
+    memcpy(cached.buildId, buildId, sizeof(buildId));
+    cached.size = size;
+    POTAStore::save(key, &cached, sizeof(cached));
+
+    POTASha256::toHex(cached.digest, sizeof(cached.digest), _runningChecksum);
+    _runningImageSize = size;
+    return POTAError::SUCCESS;
+}
+#endif
+
+// -------------------- Pre-flight --------------------
+// Bytes available for a new image
+static size_t updateCapacity() {
+#if defined(ESP32)
+    const esp_partition_t* next = esp_ota_get_next_update_partition(nullptr);
+    return next ? next->size : 0;
+#elif defined(ESP8266)
+    return ESP.getFreeSketchSpace();
+#elif defined(ARDUINO_OPTA)
+    // The compressed download lands on the QSPI file system
+    if (optaBegin() != POTAError::SUCCESS) return 0;
+    struct statvfs fs;
+    if (statvfs("/fs", &fs) != 0) return 0;
+    return (size_t)fs.f_bavail * fs.f_frsize;
+#endif
+}
+
+#if defined(ESP32) || defined(ESP8266)
+// Image flash size field (header byte 3, high nibble) in bytes
+static uint32_t imageFlashSize(uint8_t code) {
+#if defined(ESP32)
+    return code <= 7 ? (1UL << 20) << code : 0;           // 1 MB ... 128 MB
+#else
+    static const uint32_t sizes[] = { 512UL << 10, 256UL << 10, 1UL << 20, 2UL << 20, 4UL << 20,
+                                      0, 0, 0, 8UL << 20, 16UL << 20 };
+    return code < sizeof(sizes) / sizeof(sizes[0]) ? sizes[code] : 0;
+#endif
+}
+
+// Physical flash size of this board
+static uint32_t chipFlashSize() {
+#if defined(ESP8266)
+    return ESP.getFlashChipRealSize(); // getFlashChipSize() only reports the sketch's setting
+#else
+    return ESP.getFlashChipSize();
+#endif
+}
+
+// Quad modes need all four data lines wired; dual/single images run everywhere
+static bool flashModeSupported(uint8_t imageMode) {
+    FlashMode_t chipMode = ESP.getFlashChipMode();
+    bool imageQuad = imageMode == FM_QIO || imageMode == FM_QOUT;
+    bool chipQuad = chipMode == FM_QIO || chipMode == FM_QOUT;
+    return !imageQuad || chipQuad;
+}
+#endif
+
+// Validate the first bytes of an image against this device
+static POTAError checkImageHeader(const uint8_t* header, size_t len) {
+#if defined(ESP32) || defined(ESP8266)
+    #if defined(ESP8266)
+        if (len >= 2 && header[0] == 0x1f && header[1] == 0x8b) return POTAError::SUCCESS; // gzip image
+    #endif
+    if (len < 4) return POTAError::SUCCESS; // Too short to judge, Update checks it later
+    if (header[0] != 0xE9) {
+        Serial.println("❌ Not a firmware image");
+        return POTAError::IMAGE_INCOMPATIBLE;
+    }
+    if (!flashModeSupported(header[2])) {
+        Serial.println("❌ Image flash mode not supported by this board");
+        return POTAError::IMAGE_INCOMPATIBLE;
+    }
+    uint32_t flashSize = imageFlashSize(header[3] >> 4);
+    if (flashSize > chipFlashSize()) {
+        Serial.println("❌ Image built for a larger flash chip");
+        return POTAError::IMAGE_INCOMPATIBLE;
+    }
+    #if defined(ESP32) && defined(CONFIG_IDF_FIRMWARE_CHIP_ID)
+        if (len >= 14 && (header[12] | (header[13] << 8)) != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+            Serial.println("❌ Image built for a different chip");
+            return POTAError::IMAGE_INCOMPATIBLE;
+        }
+    #endif
+#else
+    (void)header;
+    (void)len; // LZSS-compressed on Opta, nothing to peek at
+#endif
+    return POTAError::SUCCESS;
+}
+
+POTAError POTA::preflightUpdate(const POTAUpdateInfo& info) {
+    char value[16];
+    if (info.size > 0) {
+        size_t capacity = _sink->capacity();
+        if (info.size > capacity) {
+            Serial.printf("❌ Image of %lu bytes does not fit (%lu available)\n",
+                          (unsigned long)info.size, (unsigned long)capacity);
+            return POTAError::IMAGE_TOO_LARGE;
+        }
+    }
+    if (!_sink->isLocal()) return POTAError::SUCCESS; // Chip and flash fields describe this device
+#if defined(ESP32) && defined(CONFIG_IDF_FIRMWARE_CHIP_ID)
+    if (manifestGet(info.manifest, "chip_id", value, sizeof(value)) &&
+        strtoul(value, nullptr, 10) != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+        Serial.println("❌ Image built for a different chip");
+        return POTAError::IMAGE_INCOMPATIBLE;
+    }
+#endif
+#if defined(ESP32) || defined(ESP8266)
+    if (manifestGet(info.manifest, "flash_size", value, sizeof(value)) &&
+        strtoul(value, nullptr, 10) > chipFlashSize()) {
+        Serial.println("❌ Image built for a larger flash chip");
+        return POTAError::IMAGE_INCOMPATIBLE;
+    }
+    if (manifestGet(info.manifest, "flash_mode", value, sizeof(value)) &&
+        !flashModeSupported((uint8_t)strtoul(value, nullptr, 10))) {
+        Serial.println("❌ Image flash mode not supported by this board");
+        return POTAError::IMAGE_INCOMPATIBLE;
+    }
+#endif
+    (void)value;
     return POTAError::SUCCESS;
+}
+
+// -------------------- Image Streaming --------------------
+// Split an http(s) URL into host, port and path (path points into url)
+static bool parseUrl(const char* url, bool& secure, char* host, size_t hostSize,
+                     uint16_t& port, const char*& path)
+{
+    if (strncmp(url, "https://", 8) == 0) {
+        secure = true;
+        port = 443;
+        url += 8;
+    } else if (strncmp(url, "http://", 7) == 0) {
+        secure = false;
+        port = 80;
+        url += 7;
+    } else {
+        return false;
+    }
+
+    const char* hostEnd = url + strcspn(url, ":/");
+    size_t hostLen = hostEnd - url;
+    if (hostLen == 0 || hostLen >= hostSize) return false;
+    memcpy(host, url, hostLen);
+    host[hostLen] = '\0';
+
+    if (*hostEnd == ':') {
+        char* portEnd;
+        unsigned long value = strtoul(hostEnd + 1, &portEnd, 10);
+        if (value == 0 || value > 65535) return false;
+        port = (uint16_t)value;
+        hostEnd = portEnd;
+    }
+    path = (*hostEnd == '/') ? hostEnd : "/";
+    return true;
+}
+
+// Send a GET request; rangeFirst < 0 requests the whole resource, rangeLast < 0 an open range
+static void sendHttpGet(Client& client, const char* host, const char* path, long rangeFirst, long rangeLast) {
+    client.print("GET ");
+    client.print(path);
+    client.println(" HTTP/1.1");
+    client.print("Host: ");
+    client.println(host);
+    if (rangeFirst >= 0) {
+        client.print("Range: bytes=");
+        client.print(rangeFirst);
+        client.print("-");
+        if (rangeLast >= 0) client.print(rangeLast);
+        client.println();
+    }
+    client.println("Connection: close");
+    client.println();
+}
+
+// Read an HTTP status line and headers; returns the status code or -1
+static int readHttpResponseHead(Client& client, long& contentLength, long& rangeStart,
+                                bool (*idle)(void*) = nullptr, void* ctx = nullptr) {
+    contentLength = -1;
+    rangeStart = 0;
+
+    unsigned long start = millis();
+    while (client.connected() && !client.available()) {
+        if (millis() - start > POTA_HTTP_TIMEOUT_MS) return -1;
+        if (idle) {
+            if (idle(ctx)) return -1; // Paused or cancelled
+            delay(1);
+        } else {
+            delay(10);
+        }
+    }
+
+    char line[192];
+    size_t len = client.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[len] = '\0';
+    int status = -1;
+    if (sscanf(line, "HTTP/%*s %d", &status) != 1) return -1;
+
+    while (true) {
+        len = client.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[len] = '\0';
+        if (len == 0 || strcmp(line, "\r") == 0) break; // End of headers
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            contentLength = atol(line + 15);
+        } else if (strncasecmp(line, "Content-Range:", 14) == 0) {
+            const char* bytes = strstr(line, "bytes ");
+            if (bytes) rangeStart = atol(bytes + 6);
+        }
+    }
+    return status;
+}
+
+// Read at most len bytes, waiting up to POTA_HTTP_TIMEOUT_MS for data; `idle`
+// runs while waiting and returning true gives the connection up at once
+static size_t readBody(Client& client, uint8_t* buffer, size_t len,
+                       bool (*idle)(void*) = nullptr, void* ctx = nullptr) {
+    unsigned long start = millis();
+    while (!client.available()) {
+        if (!client.connected() || millis() - start > POTA_HTTP_TIMEOUT_MS) return 0;
+        if (idle && idle(ctx)) return 0; // Paused or cancelled
+        delay(1);
+    }
+    int n = client.read(buffer, len);
+    return n > 0 ? (size_t)n : 0;
+}
+
+// Read exactly len bytes; returns false on timeout or disconnect
+static bool readBodyFully(Client& client, uint8_t* buffer, size_t len,
+                          bool (*idle)(void*) = nullptr, void* ctx = nullptr) {
+    while (len > 0) {
+        size_t n = readBody(client, buffer, len, idle, ctx);
+        if (n == 0) return false;
+        buffer += n;
+        len -= n;
+    }
+    return true;
+}
+
+// -------------------- Update Sinks --------------------
+// Streamed images go to the Update class on ESP32/ESP8266 and to the
+// LZSS update file on the Opta QSPI flash
+POTAError POTAOtaSink::begin(size_t size) {
+#if defined(ESP32) || defined(ESP8266)
+    return Update.begin(size) ? POTAError::SUCCESS : POTAError::OTA_BEGIN_FAILED;
+#elif defined(ARDUINO_OPTA)
+    (void)size;
+    POTAError err = optaBegin();
+    if (err != POTAError::SUCCESS) return err;
+    _file = fopen(POTA_OPTA_UPDATE_FILE, "wb");
+    return _file ? POTAError::SUCCESS : POTAError::OTA_BEGIN_FAILED;
+#endif
+}
+
+bool POTAOtaSink::write(const uint8_t* data, size_t len) {
+#if defined(ESP32) || defined(ESP8266)
+    return Update.write(const_cast<uint8_t*>(data), len) == len;
+#elif defined(ARDUINO_OPTA)
+    return fwrite(data, 1, len, _file) == len;
+#endif
+}
+
+// Discard a partially written image without touching the boot configuration
+void POTAOtaSink::abort() {
+#if defined(ESP32)
+    Update.abort();
+#elif defined(ESP8266)
+    Update.end(false); // Image is never complete here, so this only resets the updater
+#elif defined(ARDUINO_OPTA)
+    if (_file) fclose(_file);
+    _file = nullptr;
+    remove(POTA_OPTA_UPDATE_FILE);
+#endif
+}
+
+// Make a complete, verified image the next one to boot
+POTAError POTAOtaSink::finalize(const uint8_t* digest) {
+    (void)digest; // Already matched by the download pipeline
+#if defined(ESP32) || defined(ESP8266)
+    return Update.end(true) ? POTAError::SUCCESS : POTAError::OTA_APPLY_FAILED;
+#elif defined(ARDUINO_OPTA)
+    fclose(_file);
+    _file = nullptr;
+    Serial.println("🗜️ Decompressing OTA firmware...");
+    if (optaOta().decompress() <= 0) return POTAError::OTA_DECOMPRESSION_FAILED;
+    return POTAError::SUCCESS; // The bootloader is armed by activateUpdate()
+#endif
+}
+
+size_t POTAOtaSink::capacity() {
+    return updateCapacity();
+}
+
+bool POTA::setUpdateSink(POTAUpdateSink* sink) {
+    if (!sink) sink = &_otaSink;
+    if (sink == _sink) return true;
+    if (_transferActive) return false; // E.g. from the yield hook: the running download owns the sink
+    discardPartial(); // A partial image cannot move to another destination
+    _sink = sink;
+    return true;
+}
+
+void POTA::discardPartial() {
+    if (!_partialChecksum[0]) return;
+    _sink->abort();
+    _partialChecksum[0] = '\0';
+}
+
+// Candidate sources of an image: the primary URL plus the signed mirrors
+// usable over this link (mirrorList is split in place); returns their count
+static size_t collectSources(const char* primaryUrl, char* mirrorList, bool allowPlainHttp, const char** urls) {
+    size_t count = 0;
+    urls[count++] = primaryUrl;
+    for (char* url = mirrorList; url && *url && count < POTA_MAX_MIRRORS + 1; ) {
+        char* next = strchr(url, '|');
+        if (next) *next++ = '\0';
+        bool https = strncmp(url, "https://", 8) == 0;
+        bool http = strncmp(url, "http://", 7) == 0;
+        if (https || (http && allowPlainHttp)) urls[count++] = url;
+        url = next;
+    }
+    return count;
+}
+
+POTAError POTA::streamImage(const char* url, const char* expectedChecksum) {
+    return streamImage(&url, 1, expectedChecksum, nullptr);
+}
+
+// -------------------- Streamed Transfers --------------------
+// None of the steps waits for the network: streamImage() drives them with
+// blocking reads, co_streamImage() suspends between them instead
+enum class POTA::StreamStep : uint8_t {
+    CONTINUE = 0,   // Go on with the current attempt
+    WROTE,          // Data went to the sink
+    RETRY,          // Connection closed, try again (same or next source)
+    UNREACHABLE,    // Connect failed, wait a moment before trying again
+    EXHAUSTED,      // Every source used up its retries
+    STOP            // Finished early, the result is in `err`
+};
 
+struct POTA::StreamState {
+    StreamState(const char* const* sourceUrls, size_t sourceCount, const char* checksum)
+        : urls(sourceUrls), urlCount(sourceCount), expectedChecksum(checksum) {}
+
+    const char* const* urls;
+    size_t urlCount;
+    const char* expectedChecksum;
+    WiFiClient plainClient;
+    Client* client = nullptr;       // Connection of the current attempt
+    size_t source = 0;              // Index of the source in use
+    int attempts = 0;               // Consecutive failures of that source
+    unsigned long startTime = 0;
+    bool started = false;           // The sink has begun receiving this image
+    size_t total = 0;
+    size_t written = 0;
+    size_t firstByte = 0;           // Resume point of this call
+    bool chunked = false;           // Verify whole chunks before writing them
+    bool corrupted = false;         // The last attempt ended on a chunk that failed its hash
+    uint8_t* data = nullptr;        // Receive buffer of the current attempt
+    size_t pending = 0;             // Bytes of an incomplete chunk in `data`
+    uint8_t buffer[POTA_STREAM_BUFFER_SIZE];
+    uint8_t digest[POTA_SHA256_SIZE];
+};
+
+POTAError POTA::streamImage(const char* const* urls, size_t urlCount,
+                            const char* expectedChecksum, size_t* usedSource)
+{
+    if (!urls || urlCount == 0) return POTAError::PARAMETER_INVALID_OTA_URL;
+    if (!POTASha256::isHexDigest(expectedChecksum)) return POTAError::OTA_CHECKSUM_MISMATCH;
+
+    StreamState s(urls, urlCount, expectedChecksum);
+    POTAError err = POTAError::SUCCESS;
+    streamStart(s);
+    while (!s.started || s.written < s.total) {
+        StreamStep step = streamConnect(s, err);
+        if (step == StreamStep::STOP) return err;
+        if (step == StreamStep::EXHAUSTED) break;
+        if (step == StreamStep::UNREACHABLE) idle(500);
+        if (step != StreamStep::CONTINUE) continue;
+
+        long contentLength;
+        long rangeStart;
+        int status = readHttpResponseHead(*s.client, contentLength, rangeStart, idleWait, this);
+        step = streamAccept(s, status, contentLength, rangeStart, err);
+        if (step == StreamStep::STOP) return err;
+        if (step != StreamStep::CONTINUE) continue;
+
+        // --- Stream body: hash, then write (whole verified chunks when chunk hashes are loaded) ---
+        while (s.written < s.total) {
+            size_t received = readBody(*s.client, s.data + s.pending, streamWant(s), idleWait, this);
+            step = streamConsume(s, received, err);
+            if (step == StreamStep::STOP) return err;
+            if (step == StreamStep::RETRY) break;
+            throttle();
+        }
+        s.client->stop();
+    }
+    return streamFinish(s, usedSource);
+}
+
+void POTA::streamStart(StreamState& s) {
+    s.startTime = millis();
+    beginDownload();
+
+    // Continue a cancelled transfer of the same image, otherwise start afresh
+    s.started = _partialChecksum[0] && strcasecmp(_partialChecksum, s.expectedChecksum) == 0;
+    if (!s.started) {
+        discardPartial();
+        _streamSha.begin();
+    }
+    s.total = s.started ? _partialTotal : 0;
+    s.written = s.started ? _partialWritten : 0;
+    s.firstByte = s.written;
+    _progressBytes = s.written;
+    if (s.total) _progressTotal = s.total;
+    _partialChecksum[0] = '\0';
+}
+
+// Stop without finishing the image, so a later call can continue it
+POTAError POTA::streamKeepPartial(StreamState& s, POTAError reason) {
+    recordDownload(s.written, millis() - s.startTime);
+    if (s.started) {
+        strncpy(_partialChecksum, s.expectedChecksum, sizeof(_partialChecksum) - 1);
+        _partialChecksum[sizeof(_partialChecksum) - 1] = '\0';
+        _partialWritten = s.written;
+        _partialTotal = s.total;
+    }
+    return reason;
+}
+
+POTA::StreamStep POTA::streamConnect(StreamState& s, POTAError& err) {
+    // Paused: the connection is closed, wait here; cancelled: keep the progress
+    if (_holdTransfer) {
+        if (!waitWhilePaused()) {
+            err = streamKeepPartial(s, POTAError::DOWNLOAD_CANCELLED);
+            return StreamStep::STOP;
+        }
+        s.attempts = 0; // A pause is not a failure
+    }
+
+    // Move to the next source once this one has used up its retries
+    if (s.attempts++ > POTA_DOWNLOAD_RETRIES) {
+        if (++s.source >= s.urlCount) return StreamStep::EXHAUSTED;
+        s.attempts = 1;
+        Serial.print("🔀 Failing over to ");
+        Serial.println(s.urls[s.source]);
+    }
+
+    bool secure;
+    char host[128];
+    uint16_t port;
+    const char* path;
+    if (!s.urls[s.source] || !parseUrl(s.urls[s.source], secure, host, sizeof(host), port, path)) {
+        s.attempts = POTA_DOWNLOAD_RETRIES + 1; // Unusable source, skip it
+        return StreamStep::RETRY;
+    }
+    s.client = &s.plainClient;
+    if (secure) {
+        if (!_client) {
+            err = POTAError::CLIENT_NOT_INITIALIZED;
+            return StreamStep::STOP;
+        }
+        s.client = _client;
+#if defined(ESP8266)
+        configureTlsBuffers(host, true);
+#endif
+    }
+    _stats.downloadSecure = secure;
+
+    if (!s.client->connect(host, port)) return StreamStep::UNREACHABLE;
+    if (secure) chargeHandshake(true);
+
+    // --- Send HTTP GET, resuming where the previous attempt stopped ---
+    sendHttpGet(*s.client, host, path, s.started ? (long)s.written : -1, -1);
+    return StreamStep::CONTINUE;
+}
+
+POTA::StreamStep POTA::streamAccept(StreamState& s, int status, long contentLength, long rangeStart,
+                                    POTAError& err) {
+    if (_holdTransfer) {
+        s.client->stop(); // Paused or cancelled before the response, handled before reconnecting
+        return StreamStep::RETRY;
+    }
+    if (!s.started) {
+        if (status != 200 || contentLength <= 0) {
+            s.client->stop();
+            s.attempts = POTA_DOWNLOAD_RETRIES + 1; // Source does not have the image
+            return StreamStep::RETRY;
+        }
+        s.total = (size_t)contentLength;
+        _progressTotal = s.total;
+        if (!_update.size && strcasecmp(s.expectedChecksum, _update.checksum) == 0 &&
+            !dataBudgetAllows(s.total, true)) {
+            s.client->stop(); // Unsigned size: judged here, before anything is written
+            Serial.println("💸 Data budget too tight for a full image, deferring");
+            err = POTAError::DATA_BUDGET_EXCEEDED;
+            return StreamStep::STOP;
+        }
+        if (s.total > _sink->capacity()) {
+            s.client->stop();
+            Serial.println("❌ Image does not fit the update sink");
+            err = POTAError::IMAGE_TOO_LARGE;
+            return StreamStep::STOP;
+        }
+        err = _sink->begin(s.total);
+        if (err != POTAError::SUCCESS) {
+            s.client->stop();
+            return StreamStep::STOP;
+        }
+        s.started = true;
+    } else if (status != 206 || (size_t)rangeStart != s.written) {
+        s.client->stop(); // Source cannot resume this transfer
+        s.attempts = POTA_DOWNLOAD_RETRIES + 1;
+        return StreamStep::RETRY;
+    }
+    s.chunked = _chunkHashes && strcasecmp(s.expectedChecksum, _update.checksum) == 0 &&
+                s.written % _chunkSize == 0 && _chunkCount == (s.total + _chunkSize - 1) / _chunkSize;
+    s.data = s.chunked ? _chunkBuffer : s.buffer;
+    s.pending = 0;
+    return StreamStep::CONTINUE;
+}
+
+size_t POTA::streamWant(const StreamState& s) const {
+    size_t unit = s.chunked ? _chunkSize : sizeof(s.buffer);
+    if (unit > s.total - s.written) unit = s.total - s.written;
+    return unit - s.pending;
+}
+
+POTA::StreamStep POTA::streamConsume(StreamState& s, size_t received, POTAError& err) {
+    if (_holdTransfer) return StreamStep::RETRY; // Paused or cancelled, handled before reconnecting
+    if (received == 0) return StreamStep::RETRY; // Stalled or dropped, retry with Range
+    size_t unit = s.pending + streamWant(s);
+    countDownload(received);
+    s.pending += received;
+
+    if (s.chunked) {
+        if (s.pending < unit) return StreamStep::CONTINUE; // Chunk not complete yet
+        if (!chunkMatches(s.written / _chunkSize, s.data, unit)) {
+            Serial.printf("⚠️ Chunk %lu corrupted, fetching it again\n", (unsigned long)(s.written / _chunkSize));
+            s.corrupted = true;
+            return StreamStep::RETRY; // Reconnect with a Range request at the start of this chunk
+        }
+        s.corrupted = false;
+    }
+    size_t n = s.pending;
+    s.pending = 0;
+
+    // Peek at the image header before committing anything to flash
+    if (s.written == 0 && _sink->isLocal()) {
+        err = checkImageHeader(s.data, n);
+        if (err != POTAError::SUCCESS) {
+            s.client->stop();
+            _sink->abort();
+            return StreamStep::STOP;
+        }
+    }
+
+    _streamSha.update(s.data, n);
+    if (s.written + n == s.total) {
+        // Verify before the final write so a bad image never completes
+        _streamSha.finish(s.digest);
+        if (!POTASha256::matchesHex(s.digest, s.expectedChecksum)) {
+            s.client->stop();
+            _sink->abort();
+            Serial.println("❌ Image checksum mismatch");
+            err = POTAError::OTA_CHECKSUM_MISMATCH;
+            return StreamStep::STOP;
+        }
+    }
+    if (!_sink->write(s.data, n)) {
+        s.client->stop();
+        _sink->abort();
+        err = POTAError::OTA_WRITE_FAILED;
+        return StreamStep::STOP;
+    }
+    s.written += n;
+    s.attempts = 0; // Only consecutive failures count against the retry budget
+
+    if (linkTooSlow(s.written - s.firstByte, s.total - s.firstByte, s.startTime)) {
+        s.client->stop();
+        err = streamKeepPartial(s, deferUpdate());
+        return StreamStep::STOP;
+    }
+    return StreamStep::WROTE;
+}
+
+POTAError POTA::streamFinish(StreamState& s, size_t* usedSource) {
+    recordDownload(s.written, millis() - s.startTime);
+    if (!s.started) return POTAError::OTA_DOWNLOAD_FAILED;
+    if (s.written < s.total) {
+        _sink->abort();
+        return s.corrupted ? POTAError::OTA_CHECKSUM_MISMATCH : POTAError::OTA_DOWNLOAD_FAILED;
+    }
+    if (usedSource) *usedSource = s.source;
+    return _sink->finalize(s.digest);
+}
+
+void POTA::recordDownload(uint32_t bytes, uint32_t elapsedMs) {
+    _stats.downloadBytes = bytes;
+    _stats.downloadTimeMs = elapsedMs;
+    _stats.downloadRateBps = elapsedMs ? (uint32_t)((uint64_t)bytes * 1000 / elapsedMs) : 0;
+    _stats.rateLimitBps = _rateLimitBps;
+    saveUsage();
+
+    // Compare boosted downloads against the last one made without the profile
+    if (bytes < POTA_LINK_PROBE_BYTES || elapsedMs == 0 || _rateLimitBps) return; // Too small or not link-bound
+    if (_baselineRateBps == 0) POTAStore::load("baserate", &_baselineRateBps, sizeof(_baselineRateBps));
+    if (!POTAPerformanceScope::active()) {
+        _baselineRateBps = _stats.downloadRateBps;
+        POTAStore::save("baserate", &_baselineRateBps, sizeof(_baselineRateBps));
+    } else if (_baselineRateBps) {
+        uint32_t baselineMs = (uint32_t)((uint64_t)bytes * 1000 / _baselineRateBps);
+        _stats.profileSavedMs = baselineMs > elapsedMs ? baselineMs - elapsedMs : 0;
+        Serial.printf("⚡ Performance profile: ~%lu ms faster than the unboosted baseline\n",
+                      (unsigned long)_stats.profileSavedMs);
+    }
+}
+
+// -------------------- Local Update --------------------
+POTAError POTA::loadLocalDescriptor(POTAUpdateSource& source) {
+    // Both on the heap: parseSignedUpdate() adds its JSON document to ESP8266's 4 KB stack
+    char* buffer = (char*)malloc(POTA_RESPONSE_BUFFER_SIZE);
+    POTAUpdateInfo* info = new (std::nothrow) POTAUpdateInfo();
+    POTAError err = POTAError::SOURCE_READ_FAILED;
+    if (buffer && info) {
+        size_t len = source.readDescriptor(buffer, POTA_RESPONSE_BUFFER_SIZE);
+        long timestamp;
+        if (len == 0) err = POTAError::SOURCE_READ_FAILED;
+        else if (len >= POTA_RESPONSE_BUFFER_SIZE - 1) err = POTAError::BUFFER_OVERFLOW_RESPONSE; // Possibly truncated
+        else {
+            err = parseSignedUpdate(buffer, *info, timestamp);
+            if (err == POTAError::SUCCESS && !info->available) err = POTAError::NO_UPDATE_AVAILABLE;
+            if (err == POTAError::SUCCESS && !POTASha256::isHexDigest(info->checksum)) err = POTAError::OTA_CHECKSUM_MISMATCH;
+            if (err == POTAError::SUCCESS) _update = *info;
+        }
+    }
+    free(buffer);
+    delete info;
+    return err;
+}
+
+POTAError POTA::performLocalUpdate(POTAUpdateSource& source) {
+    if (coroutineActive()) return POTAError::OPERATION_IN_PROGRESS;
+    // --- Verify the descriptor exactly like a server reply ---
+    POTAError err = loadLocalDescriptor(source);
+    if (err != POTAError::SUCCESS) return err;
+    Serial.print("📂 Local firmware version: ");
+    Serial.println(_update.version);
+
+    POTATransferScope transfer(_transferActive, _cancelRequested, _pauseRequested, _holdTransfer);
+    POTAPerformanceScope profile(_performanceProfile, _stats);
+#if defined(ESP32) || defined(ESP8266)
+    if (_sink->isLocal() && hashRunningImage() == POTAError::SUCCESS &&
+        strcasecmp(_update.checksum, _runningChecksum) == 0) {
+        Serial.println("✅ Local firmware is already running");
+        return POTAError::ALREADY_RUNNING;
+    }
 #endif
+    err = preflightUpdate(_update);
+    if (err != POTAError::SUCCESS) return err;
+
+    if (_sink->isLocal()) dropStagedUpdate();
+    discardPartial(); // A cancelled network download cannot be continued from here
+    err = readLocalImage(source);
+    if (err != POTAError::SUCCESS) return err;
+    return completeUpdate();
 }
 
+POTAError POTA::readLocalImage(POTAUpdateSource& source) {
+    size_t total = 0;
+    POTAError err = source.open(total);
+    if (err != POTAError::SUCCESS) return err;
+    if (total == 0 || (_update.size && total != _update.size)) {
+        source.close();
+        Serial.println("❌ Local image size does not match the descriptor");
+        return POTAError::OTA_CHECKSUM_MISMATCH;
+    }
+    if (total > _sink->capacity()) {
+        source.close();
+        Serial.println("❌ Image does not fit the update sink");
+        return POTAError::IMAGE_TOO_LARGE;
+    }
+
+    // Sector-sized reads: one read and one flash write per sector, no per-packet overhead
+    uint8_t* buffer = (uint8_t*)malloc(POTA_LOCAL_READ_SIZE);
+    if (!buffer) {
+        source.close();
+        return POTAError::OTA_BEGIN_FAILED;
+    }
+    err = _sink->begin(total);
+    if (err != POTAError::SUCCESS) {
+        free(buffer);
+        source.close();
+        return err;
+    }
+
+    beginDownload(); // Yield accounting only: no rate limit or data budget applies here
+    _progressTotal = total;
+    unsigned long start = millis();
+    uint8_t digest[POTA_SHA256_SIZE];
+    size_t done = 0;
+    _streamSha.begin();
+    while (done < total) {
+        if (_holdTransfer && !waitWhilePaused()) {
+            err = POTAError::DOWNLOAD_CANCELLED;
+            break;
+        }
+        size_t n = total - done < POTA_LOCAL_READ_SIZE ? total - done : POTA_LOCAL_READ_SIZE;
+        if (source.read(buffer, n) != n) {
+            err = POTAError::SOURCE_READ_FAILED;
+            break;
+        }
+        if (done == 0 && _sink->isLocal()) {
+            err = checkImageHeader(buffer, n);
+            if (err != POTAError::SUCCESS) break;
+        }
+        _streamSha.update(buffer, n);
+        if (done + n == total) {
+            // Verify before the final write so a bad image never completes
+            _streamSha.finish(digest);
+            if (!POTASha256::matchesHex(digest, _update.checksum)) {
+                Serial.println("❌ Image checksum mismatch");
+                err = POTAError::OTA_CHECKSUM_MISMATCH;
+                break;
+            }
+        }
+        if (!_sink->write(buffer, n)) {
+            err = POTAError::OTA_WRITE_FAILED;
+            break;
+        }
+        done += n;
+        _progressBytes = done;
+        cooperate(n);
+    }
+    free(buffer);
+    source.close();
+    if (err != POTAError::SUCCESS) {
+        _sink->abort();
+        return err;
+    }
+    err = _sink->finalize(digest);
+
+    // Compare against the same image over the last measured network rate
+    _stats.localTimeMs = millis() - start;
+    uint32_t networkRate = _stats.downloadRateBps;
+    if (!networkRate) {
+        if (_baselineRateBps == 0) POTAStore::load("baserate", &_baselineRateBps, sizeof(_baselineRateBps));
+        networkRate = _baselineRateBps;
+    }
+    _stats.localNetworkMs = networkRate ? (uint32_t)((uint64_t)total * 1000 / networkRate) : 0;
+    Serial.printf("📂 Local image of %lu bytes installed in %lu ms (network ~%lu ms)\n", (unsigned long)total,
+                  (unsigned long)_stats.localTimeMs, (unsigned long)_stats.localNetworkMs);
+    return err;
+}
+
+// -------------------- Chunk Verification --------------------
+bool POTA::loadChunkHashes() {
+    freeChunkHashes();
+    char value[16];
+    char root[POTA_SHA256_HEX_SIZE];
+    char listUrl[sizeof(_update.url)];
+    uint8_t rootDigest[POTA_SHA256_SIZE];
+    if (!manifestGet(_update.manifest, "chunk_size", value, sizeof(value)) ||
+        !manifestGet(_update.manifest, "chunk_root", root, sizeof(root)) ||
+        !manifestGet(_update.manifest, "chunk_list", listUrl, sizeof(listUrl)) ||
+        !POTASha256::fromHex(root, rootDigest) || !POTASha256::isHexDigest(_update.checksum)) return false;
+    uint32_t chunkSize = strtoul(value, nullptr, 10);
+    if (chunkSize < 256 || chunkSize > POTA_CHUNK_MAX_SIZE) {
+        Serial.println("⚠️ Unsupported chunk size, verifying the whole image only");
+        return false;
+    }
+
+    bool secure;
+    char host[128];
+    uint16_t port;
+    const char* path;
+    if (!parseUrl(listUrl, secure, host, sizeof(host), port, path) || (!secure && !_allowPlainHttp)) return false;
+    WiFiClient plainClient;
+    Client* client = &plainClient;
+    if (secure) {
+        client = _client;
+#if defined(ESP8266)
+        configureTlsBuffers(host, false);
+#endif
+    }
+    if (!client->connect(host, port)) return false;
+    if (secure) chargeHandshake(true);
+    sendHttpGet(*client, host, path, -1, -1);
+    long contentLength;
+    long rangeStart;
+    int status = readHttpResponseHead(*client, contentLength, rangeStart, idleWait, this);
+    uint32_t count = contentLength > 0 ? (uint32_t)contentLength / POTA_SHA256_SIZE : 0;
+    if (status != 200 || count == 0 || contentLength % POTA_SHA256_SIZE != 0 || count > POTA_CHUNK_MAX_COUNT) {
+        client->stop();
+        Serial.println("⚠️ Chunk list unavailable, verifying the whole image only");
+        return false;
+    }
+
+    // Hash the full list against the signed root; entries are kept whole, since chunks
+    // may come from plain-HTTP mirrors and a short prefix could be matched by a forgery
+    _chunkHashes = (uint8_t*)malloc(count * POTA_SHA256_SIZE);
+    _chunkBuffer = (uint8_t*)malloc(chunkSize);
+    POTASha256 listSha;
+    uint8_t entry[POTA_SHA256_SIZE];
+    bool ok = _chunkHashes && _chunkBuffer;
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        ok = readBodyFully(*client, entry, sizeof(entry), idleWait, this);
+        if (!ok) break;
+        chargeDownload(sizeof(entry));
+        listSha.update(entry, sizeof(entry));
+        memcpy(_chunkHashes + i * POTA_SHA256_SIZE, entry, POTA_SHA256_SIZE);
+    }
+    client->stop();
+    uint8_t digest[POTA_SHA256_SIZE];
+    listSha.finish(digest);
+    if (!ok || memcmp(digest, rootDigest, sizeof(digest)) != 0) {
+        Serial.println("⚠️ Chunk list does not match chunk_root, verifying the whole image only");
+        freeChunkHashes();
+        return false;
+    }
+
+    _chunkCount = count;
+    _chunkSize = chunkSize;
+    Serial.printf("🧩 Verifying %lu chunks of %lu bytes\n", (unsigned long)count, (unsigned long)chunkSize);
+    return true;
+}
+
+void POTA::freeChunkHashes() {
+    free(_chunkHashes);
+    free(_chunkBuffer);
+    _chunkHashes = nullptr;
+    _chunkBuffer = nullptr;
+    _chunkCount = 0;
+    _chunkSize = 0;
+}
+
+bool POTA::chunkMatches(uint32_t index, const uint8_t* data, size_t len) const {
+    if (index >= _chunkCount) return false;
+    uint8_t digest[POTA_SHA256_SIZE];
+    POTASha256 sha;
+    sha.update(data, len);
+    sha.finish(digest);
+    return memcmp(digest, _chunkHashes + index * POTA_SHA256_SIZE, POTA_SHA256_SIZE) == 0;
+}
+
+// -------------------- Rate Limiting --------------------
+// Token bucket in byte-milliseconds: refilled at the configured rate, capped
+// at a quarter second of traffic (at least POTA_THROTTLE_MIN_BURST bytes)
+static int64_t bucketCapacity(uint32_t rate) {
+    uint32_t burst = rate / 4;
+    if (burst < POTA_THROTTLE_MIN_BURST) burst = POTA_THROTTLE_MIN_BURST;
+    return (int64_t)burst * 1000;
+}
+
+void POTA::beginDownload() {
+    _bucketTokens = bucketCapacity(_rateLimitBps);
+    _bucketStamp = millis();
+    _stats.throttleDelayMs = 0;
+    _stats.yieldCount = 0;
+    _stats.yieldMaxGapUs = 0;
+    _yieldPendingBytes = 0;
+    _lastYieldUs = micros();
+    loadUsage();
+    _stats.predictedTimeMs = 0;
+    _linkProbed = false;
+    _linkRejected = false;
+    _progressBytes = 0;
+    _progressTotal = _update.size;
+}
+
+void POTA::chargeDownload(size_t bytes) {
+    countDownload(bytes);
+    throttle();
+}
+
+void POTA::countDownload(size_t bytes) {
+    if (!_unmetered) _usage.downloadBytes += bytes;
+    _progressBytes = _progressBytes + bytes;
+    cooperate(bytes);
+    if (_rateLimitBps) _bucketTokens -= (int64_t)bytes * 1000;
+}
+
+void POTA::throttle() {
+    // In debt: wait in short slices, cooperating with the application meanwhile
+    while (uint32_t waitMs = throttleDelay()) idle(waitMs);
+}
+
+uint32_t POTA::throttleDelay() {
+    uint32_t rate = _rateLimitBps; // Read on every slice, so limit changes apply while waiting
+    uint32_t now = millis();
+    if (rate == 0) {
+        if (_bucketTokens < 0) _bucketTokens = 0; // Limit lifted while in debt
+        _bucketStamp = now; // Unlimited: no credit builds up meanwhile
+        return 0;
+    }
+    _bucketTokens += (int64_t)(now - _bucketStamp) * rate;
+    _bucketStamp = now;
+    int64_t capacity = bucketCapacity(rate);
+    if (_bucketTokens > capacity) _bucketTokens = capacity;
+    if (_bucketTokens >= 0) return 0;
+
+    uint32_t waitMs = (uint32_t)((-_bucketTokens + rate - 1) / rate);
+    if (waitMs > POTA_THROTTLE_SLICE_MS) waitMs = POTA_THROTTLE_SLICE_MS;
+    _stats.throttleDelayMs += waitMs;
+    return waitMs;
+}
+
+// -------------------- Cooperative Yielding --------------------
+void POTA::setYieldHook(POTAYieldHook hook, void* arg) {
+    _yieldArg = arg;
+    _yieldHook = hook;
+}
+
+void POTA::setYieldInterval(uint32_t everyBytes, uint32_t everyUs) {
+    _yieldEveryBytes = everyBytes;
+    _yieldEveryUs = everyUs;
+}
+
+void POTA::cooperate(size_t bytes) {
+    uint32_t now = micros();
+    uint32_t gap = now - _lastYieldUs;
+    _yieldPendingBytes += bytes;
+    bool due = (_yieldEveryBytes == 0 && _yieldEveryUs == 0) ||
+               (_yieldEveryBytes && _yieldPendingBytes >= _yieldEveryBytes) ||
+               (_yieldEveryUs && gap >= _yieldEveryUs);
+    if (!due) return;
+
+    if (gap > _stats.yieldMaxGapUs) _stats.yieldMaxGapUs = gap;
+    _stats.yieldCount++;
+    _yieldPendingBytes = 0;
+    yield(); // Feeds the ESP8266 soft watchdog and lets other tasks run
+    if (_yieldHook) _yieldHook(_yieldArg);
+    _lastYieldUs = micros(); // The hook's own run time is not a gap
+}
+
+void POTA::idle(uint32_t ms) {
+    unsigned long start = millis();
+    do {
+        cooperate(0);
+        delay(1);
+    } while (millis() - start < ms);
+}
+
+bool POTA::idleWait(void* self) {
+    POTA* pota = static_cast<POTA*>(self);
+    pota->cooperate(0);
+    return pota->_holdTransfer;
+}
+
+// -------------------- Coroutines --------------------
+bool POTA::coroutineActive() const {
+#if defined(__cpp_impl_coroutine)
+    return _coBusy;
+#else
+    return false;
+#endif
+}
+
+#if defined(__cpp_impl_coroutine)
+namespace {
+// Holds _coBusy for a coroutine frame, so destroying a suspended task releases it too
+class POTACoBusyScope {
+public:
+    explicit POTACoBusyScope(bool& busy) : _busy(busy) { _busy = true; }
+    ~POTACoBusyScope() { _busy = false; }
+    POTACoBusyScope(const POTACoBusyScope&) = delete;
+    POTACoBusyScope& operator=(const POTACoBusyScope&) = delete;
+private:
+    bool& _busy;
+};
+}
+
+bool POTA::coIdle(void* self) {
+    return !static_cast<POTA*>(self)->_coBusy;
+}
+
+POTATask<POTAError> POTA::co_checkForUpdate(POTAUpdateInfo& info, POTAExecutor& executor) {
+    co_await executor.until(coIdle, this); // One check or update at a time
+    POTACoBusyScope busy(_coBusy);
+    POTAPerformanceScope profile(_performanceProfile, _stats);
+    POTAError err = sendUpdateCheck(info);
+    if (err == POTAError::SUCCESS) {
+        // The server's processing time is spent in other coroutines
+        co_await executor.readable(*_client, POTA_HTTP_TIMEOUT_MS);
+        err = receiveUpdateCheck(info);
+    }
+    co_return err;
+}
+
+POTATask<POTAError> POTA::co_performUpdate(const POTAUpdateInfo& info, POTAExecutor& executor) {
+    co_await executor.until(coIdle, this);
+    POTACoBusyScope busy(_coBusy);
+    co_return co_await co_transferUpdate(info, executor);
+}
+
+POTATask<POTAError> POTA::co_transferUpdate(const POTAUpdateInfo& info, POTAExecutor& executor) {
+    if (!_client) co_return POTAError::CLIENT_NOT_INITIALIZED;
+    if (!info.available) co_return POTAError::NO_UPDATE_AVAILABLE;
+    if (!POTASha256::isHexDigest(info.checksum)) co_return POTAError::OTA_CHECKSUM_MISMATCH; // Streamed images need it
+    if (!info.url[0]) co_return POTAError::PARAMETER_INVALID_OTA_URL;
+    if (strncmp(info.url, "http://", 7) == 0 && !_allowPlainHttp) co_return POTAError::PARAMETER_INVALID_OTA_URL;
+    if (&info != &_update) _update = info;
+    POTATransferScope transfer(_transferActive, _cancelRequested, _pauseRequested, _holdTransfer);
+    POTAPerformanceScope profile(_performanceProfile, _stats);
+    POTAError err;
+    if (!prepareUpdate(err)) co_return err;
+
+    loadUsage();
+    if (_dataBudget && !dataBudgetAllows(_update.size + POTA_TLS_HANDSHAKE_BYTES, true)) {
+        Serial.println("💸 Data budget too tight for a full image, deferring");
+        co_return POTAError::DATA_BUDGET_EXCEEDED;
+    }
+
+    // The update URL first, then the signed mirrors in manifest order (probing them would block)
+    const char* urls[POTA_MAX_MIRRORS + 1];
+    char mirrors[POTA_MANIFEST_SIZE] = "";
+    manifestGet(_update.manifest, "mirrors", mirrors, sizeof(mirrors));
+    size_t count = collectSources(_update.url, mirrors, _allowPlainHttp, urls);
+
+    loadChunkHashes();
+    _usage.downloads++;
+    Serial.println("⬇️ Streaming firmware...");
+    err = co_await co_streamImage(urls, count, _update.checksum, executor);
+    freeChunkHashes();
+    if (err != POTAError::SUCCESS) co_return err;
+    co_return completeUpdate();
+}
+
+// Same steps as streamImage(), suspending wherever that one waits: for the
+// response and body data, after each sink write, and in pause and throttle waits
+POTATask<POTAError> POTA::co_streamImage(const char* const* urls, size_t urlCount,
+                                         const char* expectedChecksum, POTAExecutor& executor) {
+    StreamState s(urls, urlCount, expectedChecksum);
+    POTAError err = POTAError::SUCCESS;
+    streamStart(s);
+    while (!s.started || s.written < s.total) {
+        if (_holdTransfer && _pauseRequested && !_cancelRequested) {
+            Serial.println("⏸️ Download paused");
+            while (_pauseRequested && !_cancelRequested) co_await executor.sleep(POTA_THROTTLE_SLICE_MS);
+            if (!_cancelRequested) Serial.println("▶️ Download resumed");
+        }
+        StreamStep step = streamConnect(s, err); // connect() and the TLS handshake still block
+        if (step == StreamStep::STOP) co_return err;
+        if (step == StreamStep::EXHAUSTED) break;
+        if (step == StreamStep::UNREACHABLE) co_await executor.sleep(500);
+        if (step != StreamStep::CONTINUE) continue;
+
+        for (unsigned long since = millis(); streamWaiting(s, since);)
+            co_await executor.readable(*s.client, POTA_THROTTLE_SLICE_MS);
+        long contentLength = -1;
+        long rangeStart = 0;
+        int status = s.client->available() ? readHttpResponseHead(*s.client, contentLength, rangeStart) : -1;
+        step = streamAccept(s, status, contentLength, rangeStart, err);
+        if (step == StreamStep::STOP) co_return err;
+        if (step != StreamStep::CONTINUE) continue;
+
+        while (s.written < s.total) {
+            for (unsigned long since = millis(); streamWaiting(s, since);)
+                co_await executor.readable(*s.client, POTA_THROTTLE_SLICE_MS);
+            int n = s.client->available() ? s.client->read(s.data + s.pending, streamWant(s)) : 0;
+            step = streamConsume(s, n > 0 ? (size_t)n : 0, err);
+            if (step == StreamStep::STOP) co_return err;
+            if (step == StreamStep::RETRY) break;
+            if (step == StreamStep::WROTE) co_await executor.yield(); // Other coroutines run after each flash write
+            while (uint32_t waitMs = throttleDelay()) co_await executor.sleep(waitMs);
+        }
+        s.client->stop();
+    }
+    co_return streamFinish(s, nullptr);
+}
+
+bool POTA::streamWaiting(StreamState& s, unsigned long since) {
+    return !s.client->available() && s.client->connected() && !_holdTransfer &&
+           millis() - since < POTA_HTTP_TIMEOUT_MS;
+}
+#endif
+
+// -------------------- Post-update Canary --------------------
+static_assert(POTA_CANARY_METRICS <= 8, "Canary metrics are tracked in 8-bit masks");
+
+// Persisted across the reboot into the new image (and back, after a rollback)
+struct POTACanaryRecord {
+    uint8_t state;                          // POTACanaryState
+    uint8_t baselineSet;                    // Metrics with a baseline
+    uint8_t regressed;                      // Metrics beyond their threshold
+    char fromVersion[32];                   // Image that recorded the baseline
+    char toVersion[32];                     // Image being validated
+    float baseline[POTA_CANARY_METRICS];
+};
+
+static const char* canaryStateName(POTACanaryState state) {
+    switch (state) {
+        case POTACanaryState::PASSED: return "passed";
+        case POTACanaryState::REGRESSED: return "regressed";
+        case POTACanaryState::ROLLED_BACK: return "rolled_back";
+        default: return "";
+    }
+}
+
+void POTA::setCanaryWindow(uint32_t windowMs) {
+    _canaryWindowMs = windowMs;
+}
+
+void POTA::setCanaryMetric(uint8_t index, float maxRegressionPercent, bool higherIsBetter) {
+    if (index >= POTA_CANARY_METRICS) return;
+    _canaryLimit[index] = maxRegressionPercent;
+    _canaryMetrics |= 1 << index;
+    if (higherIsBetter) _canaryHigherBetter |= 1 << index;
+    else _canaryHigherBetter &= ~(1 << index);
+}
+
+void POTA::recordCanaryMetric(uint8_t index, float value) {
+    if (index >= POTA_CANARY_METRICS) return;
+    _canaryMean[index] += (value - _canaryMean[index]) / ++_canaryCount[index];
+}
+
+POTACanaryState POTA::getCanaryState() const {
+    return _canaryState;
+}
+
+void POTA::saveCanaryBaseline() {
+    if (_canaryWindowMs == 0) return;
+    POTACanaryRecord record = {};
+    record.state = (uint8_t)POTACanaryState::VALIDATING;
+    strncpy(record.fromVersion, _firmwareVersion, sizeof(record.fromVersion) - 1);
+    strncpy(record.toVersion, _update.version, sizeof(record.toVersion) - 1);
+    for (uint8_t i = 0; i < POTA_CANARY_METRICS; ++i) {
+        if (!(_canaryMetrics & (1 << i)) || _canaryCount[i] == 0) continue;
+        record.baseline[i] = _canaryMean[i];
+        record.baselineSet |= 1 << i;
+    }
+    POTAStore::save("canary", &record, sizeof(record));
+}
+
+void POTA::resumeCanary() {
+    POTACanaryRecord record;
+    if (!POTAStore::load("canary", &record, sizeof(record))) return;
+    _canaryState = (POTACanaryState)record.state;
+    if (_canaryState != POTACanaryState::VALIDATING) return; // Outcome waits for the next check
+
+    if (strcmp(record.fromVersion, _firmwareVersion) == 0) {
+        // Booted the previous image again: the bootloader rolled back or activation failed
+        _canaryState = POTACanaryState::ROLLED_BACK;
+    } else if (_canaryWindowMs == 0) {
+        _canaryState = POTACanaryState::PASSED; // New image does not run the canary
+    } else {
+        _canaryEndsAt = millis() + _canaryWindowMs;
+        Serial.printf("🐤 Validating firmware %s for %lu s\n", _firmwareVersion, (unsigned long)(_canaryWindowMs / 1000));
+        return;
+    }
+    record.state = (uint8_t)_canaryState;
+    POTAStore::save("canary", &record, sizeof(record));
+}
+
+void POTA::evaluateCanary() {
+    POTACanaryRecord record;
+    if (!POTAStore::load("canary", &record, sizeof(record))) {
+        _canaryState = POTACanaryState::NONE;
+        return;
+    }
+
+    record.regressed = 0;
+    for (uint8_t i = 0; i < POTA_CANARY_METRICS; ++i) {
+        uint8_t bit = 1 << i;
+        if (!(record.baselineSet & bit) || !(_canaryMetrics & bit) || _canaryCount[i] == 0) continue;
+        float base = record.baseline[i];
+        if (base == 0) continue;
+        float change = (_canaryMean[i] - base) / fabsf(base) * 100.0f;
+        float regression = (_canaryHigherBetter & bit) ? -change : change;
+        Serial.printf("🐤 Metric %u: %.2f -> %.2f (%+.1f%%)\n", i, base, _canaryMean[i], change);
+        if (regression > _canaryLimit[i]) record.regressed |= bit;
+    }
+
+    if (!record.regressed) {
+        Serial.println("✅ New firmware passed validation");
+        _canaryState = POTACanaryState::PASSED;
+        record.state = (uint8_t)_canaryState;
+        POTAStore::save("canary", &record, sizeof(record));
+#if defined(ESP32)
+        esp_ota_mark_app_valid_cancel_rollback();
+#endif
+        return;
+    }
+
+    Serial.println("❌ New firmware regressed");
+#if defined(ESP32)
+    // The other A/B slot still holds the previous image
+    record.state = (uint8_t)POTACanaryState::ROLLED_BACK;
+    POTAStore::save("canary", &record, sizeof(record));
+    Serial.println("↩️ Rolling back to the previous firmware...");
+    esp_ota_mark_app_invalid_rollback_and_reboot(); // Only returns if no valid image is left
+#endif
+    _canaryState = POTACanaryState::REGRESSED;
+    record.state = (uint8_t)_canaryState;
+    POTAStore::save("canary", &record, sizeof(record));
+}
+
+void POTA::canaryReport(char* out, size_t outSize) {
+    out[0] = '\0';
+    if (_canaryState != POTACanaryState::PASSED && _canaryState != POTACanaryState::REGRESSED &&
+        _canaryState != POTACanaryState::ROLLED_BACK) return;
+    POTACanaryRecord record;
+    if (!POTAStore::load("canary", &record, sizeof(record))) return;
+    snprintf(out, outSize, ",\"canary\":{\"result\":\"%s\",\"from\":\"%s\",\"to\":\"%s\",\"regressed\":%u}",
+             canaryStateName(_canaryState), record.fromVersion, record.toVersion, record.regressed);
+}
+
+// -------------------- Data Budget --------------------
+// Billing period of the local date (months since 1970), or 0 while the clock is unset
+static uint32_t billingPeriod(uint8_t billingDay) {
+    time_t now = time(nullptr);
+    if (now < 1609459200) return 0; // Before 2021: clock not set
+    struct tm local;
+    localtime_r(&now, &local);
+    uint32_t months = (uint32_t)(local.tm_year - 70) * 12 + local.tm_mon;
+    if (local.tm_mday < billingDay) --months; // Still in the period that began last month
+    return months;
+}
+
+void POTA::setDataBudget(uint32_t bytesPerPeriod, uint8_t billingDay) {
+    _dataBudget = bytesPerPeriod;
+    _billingDay = billingDay < 1 ? 1 : (billingDay > 28 ? 28 : billingDay);
+}
+
+const POTADataUsage& POTA::getDataUsage() {
+    loadUsage();
+    return _usage;
+}
+
+void POTA::resetDataUsage() {
+    uint32_t period = _usage.period;
+    _usage = POTADataUsage();
+    _usage.period = period;
+    _usageLoaded = true;
+    saveUsage();
+}
+
+void POTA::loadUsage() {
+    if (!_usageLoaded) {
+        POTAStore::load("usage", &_usage, sizeof(_usage));
+        _usageLoaded = true;
+    }
+    uint32_t period = billingPeriod(_billingDay);
+    if (period != 0 && period != _usage.period) {
+        // New billing period (or the first one since the clock was set)
+        _usage = POTADataUsage();
+        _usage.period = period;
+        saveUsage();
+    }
+}
+
+void POTA::saveUsage() {
+    if (_usageLoaded) POTAStore::save("usage", &_usage, sizeof(_usage));
+}
+
+void POTA::chargeHandshake(bool download) {
+    if (download) {
+        if (!_unmetered) _usage.downloadBytes += POTA_TLS_HANDSHAKE_BYTES;
+    } else {
+        _usage.checkBytes += POTA_TLS_HANDSHAKE_BYTES;
+    }
+}
+
+bool POTA::dataBudgetAllows(uint32_t bytes, bool keepReserve) {
+    if (_dataBudget == 0) return true;
+    uint64_t used = (uint64_t)_usage.checkBytes + _usage.downloadBytes;
+    uint64_t limit = _dataBudget;
+    if (keepReserve) limit -= limit * POTA_DATA_RESERVE_PERCENT / 100;
+    return used + bytes <= limit;
+}
+
+// -------------------- Link Policy --------------------
+void POTA::setLinkPolicy(const POTALinkPolicy& policy) {
+    _linkPolicy = policy;
+    if (_linkPolicy.probeBytes == 0) _linkPolicy.probeBytes = POTA_LINK_PROBE_BYTES;
+}
+
+bool POTA::isDeferred() const {
+    return _deferred;
+}
+
+bool POTA::isRetryDue() const {
+    return _retryDue;
+}
+
+POTAError POTA::retryDeferredUpdate() {
+    if (!_retryDue) return POTAError::NO_UPDATE_AVAILABLE;
+    return performUpdate(_update);
+}
+
+bool POTA::linkAcceptable(uint32_t predictedMs) {
+    int32_t rssi = WiFi.RSSI();
+    _stats.linkRssi = rssi;
+    if (_linkPolicy.accept) return _linkPolicy.accept(rssi, predictedMs);
+    if (rssi < _linkPolicy.minRssi) return false;
+    return _linkPolicy.maxTransferMs == 0 || predictedMs <= _linkPolicy.maxTransferMs;
+}
+
+bool POTA::linkTooSlow(uint32_t received, uint32_t total, unsigned long startMs) {
+    if (_linkProbed || total == 0 || received < _linkPolicy.probeBytes) return false;
+    _linkProbed = true;
+
+    uint32_t elapsed = millis() - startMs;
+    _stats.predictedTimeMs = (uint32_t)((uint64_t)elapsed * total / received);
+    Serial.print("⏱️ Projected download time: ");
+    Serial.print(_stats.predictedTimeMs / 1000);
+    Serial.println(" s");
+    if (linkAcceptable(_stats.predictedTimeMs)) return false;
+    _linkRejected = true;
+    return true;
+}
+
+POTAError POTA::deferUpdate() {
+    _deferred = true;
+    _retryDue = false;
+    _deferredRssi = _stats.linkRssi;
+    _deferRetryAt = millis() + POTA_LINK_RETRY_MS;
+    Serial.print("📶 Link too weak or slow for the download (RSSI ");
+    Serial.print(_stats.linkRssi);
+    Serial.println(" dBm), deferring update");
+    return POTAError::DOWNLOAD_DEFERRED;
+}
+
+// -------------------- Mirrors --------------------
+// TCP connect time to each mirror's host in microseconds (ULONG_MAX if unreachable
+// within POTA_MIRROR_PROBE_MS). Hosts are resolved first, so only the connect is timed.
+static void probeMirrors(const char* const* urls, size_t count, unsigned long* rtt) {
+    IPAddress address[POTA_MAX_MIRRORS + 1];
+    uint16_t port[POTA_MAX_MIRRORS + 1];
+    bool resolved[POTA_MAX_MIRRORS + 1];
+    for (size_t i = 0; i < count; ++i) {
+        bool secure;
+        char host[128];
+        const char* path;
+        rtt[i] = ULONG_MAX;
+        resolved[i] = parseUrl(urls[i], secure, host, sizeof(host), port[i], path) &&
+                      WiFi.hostByName(host, address[i]) == 1;
+    }
+
+#if defined(ESP32)
+    // Non-blocking connects raced against one deadline
+    int fds[POTA_MAX_MIRRORS + 1];
+    size_t pending = 0;
+    unsigned long t0 = micros();
+    for (size_t i = 0; i < count; ++i) {
+        fds[i] = resolved[i] ? socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) : -1;
+        if (fds[i] < 0) continue;
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK);
+        struct sockaddr_in target = {};
+        target.sin_family = AF_INET;
+        target.sin_port = htons(port[i]);
+        target.sin_addr.s_addr = (uint32_t)address[i];
+        if (connect(fds[i], (struct sockaddr*)&target, sizeof(target)) == 0) {
+            rtt[i] = micros() - t0;
+        } else if (errno == EINPROGRESS) {
+            ++pending;
+            continue;
+        }
+        close(fds[i]);
+        fds[i] = -1;
+    }
+
+    unsigned long deadline = (unsigned long)POTA_MIRROR_PROBE_MS * 1000;
+    while (pending > 0) {
+        unsigned long elapsed = micros() - t0;
+        if (elapsed >= deadline) break;
+        fd_set writable;
+        FD_ZERO(&writable);
+        int maxFd = -1;
+        for (size_t i = 0; i < count; ++i) {
+            if (fds[i] < 0) continue;
+            FD_SET(fds[i], &writable);
+            if (fds[i] > maxFd) maxFd = fds[i];
+        }
+        struct timeval wait;
+        wait.tv_sec = (deadline - elapsed) / 1000000;
+        wait.tv_usec = (deadline - elapsed) % 1000000;
+        if (select(maxFd + 1, nullptr, &writable, nullptr, &wait) <= 0) break;
+        unsigned long now = micros() - t0;
+        for (size_t i = 0; i < count; ++i) {
+            if (fds[i] < 0 || !FD_ISSET(fds[i], &writable)) continue;
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
+                rtt[i] = now;
+                // The rest only matter if they can still win a near-tie (see downloadFromMirrors())
+                unsigned long tieWindow = now + now / 4 + 1000;
+                if (tieWindow < deadline) deadline = tieWindow;
+            }
+            close(fds[i]);
+            fds[i] = -1;
+            --pending;
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+#else
+    // The Arduino clients cannot connect without blocking: one short, bounded connect each
+    for (size_t i = 0; i < count; ++i) {
+        if (!resolved[i]) continue;
+        WiFiClient probe;
+    #if defined(ESP8266)
+        probe.setTimeout(POTA_MIRROR_PROBE_MS);
+    #else
+        probe.setSocketTimeout(POTA_MIRROR_PROBE_MS);
+    #endif
+        unsigned long t0 = micros();
+        if (probe.connect(address[i], port[i])) rtt[i] = micros() - t0;
+        probe.stop();
+    }
+#endif
+}
+
+// Host part of a URL, used to remember the preferred mirror
+static bool mirrorHost(const char* url, char* host, size_t hostSize) {
+    bool secure;
+    uint16_t port;
+    const char* path;
+    return parseUrl(url, secure, host, hostSize, port, path);
+}
+
+POTAError POTA::downloadFromMirrors(const char* primaryUrl, char* mirrorList) {
+    const char* urls[POTA_MAX_MIRRORS + 1];
+    size_t count = collectSources(primaryUrl, mirrorList, _allowPlainHttp, urls);
+
+    // --- Probe every candidate; the remembered winner wins near-ties ---
+    char preferred[64] = "";
+    POTAStore::load("mirror", preferred, sizeof(preferred));
+    preferred[sizeof(preferred) - 1] = '\0';
+    unsigned long rtt[POTA_MAX_MIRRORS + 1];
+    probeMirrors(urls, count, rtt);
+    for (size_t i = 0; i < count; ++i) {
+        char host[64];
+        if (rtt[i] != ULONG_MAX && mirrorHost(urls[i], host, sizeof(host)) && strcmp(host, preferred) == 0)
+            rtt[i] -= rtt[i] / 5;
+    }
+
+    // Insertion sort by probe time; unreachable sources stay as a last resort
+    for (size_t i = 1; i < count; ++i) {
+        for (size_t j = i; j > 0 && rtt[j] < rtt[j - 1]; --j) {
+            unsigned long t = rtt[j]; rtt[j] = rtt[j - 1]; rtt[j - 1] = t;
+            const char* u = urls[j]; urls[j] = urls[j - 1]; urls[j - 1] = u;
+        }
+    }
+
+    Serial.print("🌍 Downloading from fastest mirror: ");
+    Serial.println(urls[0]);
+    size_t used = 0;
+    POTAError err = streamImage(urls, count, _update.checksum, &used);
+    if (err != POTAError::SUCCESS) return err;
+
+    // Remember the source that completed the transfer
+    char host[64] = "";
+    if (mirrorHost(urls[used], host, sizeof(host))) POTAStore::save("mirror", host, sizeof(host));
+    return POTAError::SUCCESS;
+}
+
+// -------------------- Multicast Receive (ESP32) --------------------
+#if defined(ESP32)
+namespace {
+// Writes reassembled blocks straight into the inactive OTA partition
+class PartitionStorage : public POTAMcastStorage {
+public:
+    explicit PartitionStorage(const esp_partition_t* partition) : _partition(partition) {}
+
+    bool begin(uint32_t imageSize) override {
+        if (!_partition || imageSize > _partition->size) return false;
+        // Blocks arrive out of order, so erase the whole range up front
+        uint32_t eraseSize = (imageSize + 4095) & ~(uint32_t)4095;
+        return esp_partition_erase_range(_partition, 0, eraseSize) == ESP_OK;
+    }
+
+    bool write(uint32_t offset, const uint8_t* data, size_t len) override {
+        return esp_partition_write(_partition, offset, data, len) == ESP_OK;
+    }
+
+    bool read(uint32_t offset, uint8_t* data, size_t len) override {
+        return esp_partition_read(_partition, offset, data, len) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* _partition;
+};
+}
+
+void POTA::setMulticastReceive(bool enabled, const char* group, uint16_t port, uint32_t timeoutMs) {
+    _mcastEnabled = enabled && group && _mcastGroup.fromString(group);
+    _mcastPort = port;
+    _mcastTimeoutMs = timeoutMs;
+}
+
+POTAError POTA::fillMulticastGaps(POTAMcastAssembler& assembler, const char* url) {
+    bool secure;
+    char host[128];
+    uint16_t port;
+    const char* path;
+    if (!parseUrl(url, secure, host, sizeof(host), port, path))
+        return POTAError::PARAMETER_INVALID_OTA_URL;
+
+    WiFiClient plainClient;
+    Client* client = &plainClient;
+    if (secure) {
+        if (!_client) return POTAError::CLIENT_NOT_INITIALIZED;
+        client = _client;
+    }
+
+    uint8_t block[POTA_MCAST_MAX_BLOCK_SIZE];
+    uint32_t from = 0;
+    uint32_t first;
+    uint32_t count;
+    while (assembler.nextMissingRun(from, first, count)) {
+        uint32_t startByte = first * assembler.blockSize();
+        uint32_t endByte = startByte + (count - 1) * assembler.blockSize() + assembler.blockLength(first + count - 1) - 1;
+
+        if (!client->connect(host, port)) return POTAError::CONNECTION_FAILED;
+        if (secure) chargeHandshake(true);
+        sendHttpGet(*client, host, path, startByte, endByte);
+        long contentLength;
+        long rangeStart;
+        int status = readHttpResponseHead(*client, contentLength, rangeStart, idleWait, this);
+        if (status != 206 || (uint32_t)rangeStart != startByte) {
+            client->stop();
+            if (_holdTransfer && !waitWhilePaused()) return POTAError::DOWNLOAD_CANCELLED;
+            return POTAError::OTA_DOWNLOAD_FAILED;
+        }
+        for (uint32_t i = first; i < first + count; ++i) {
+            size_t len = assembler.blockLength(i);
+            if (!readBodyFully(*client, block, len, idleWait, this)) {
+                client->stop();
+                if (_holdTransfer && !waitWhilePaused()) return POTAError::DOWNLOAD_CANCELLED;
+                return POTAError::OTA_DOWNLOAD_FAILED;
+            }
+            chargeDownload(len);
+            if (!assembler.fillBlock(i, block, len)) {
+                client->stop();
+                return POTAError::OTA_WRITE_FAILED;
+            }
+        }
+        client->stop();
+        from = first + count;
+    }
+    return POTAError::SUCCESS;
+}
+
+POTAError POTA::receiveMulticast(const char* url) {
+    uint8_t expected[POTA_SHA256_SIZE];
+    if (!POTASha256::fromHex(_update.checksum, expected)) return POTAError::OTA_CHECKSUM_MISMATCH;
+    const esp_partition_t* partition = esp_ota_get_next_update_partition(nullptr);
+    if (!partition) return POTAError::OTA_BEGIN_FAILED;
+
+    PartitionStorage storage(partition);
+    POTAMcastAssembler assembler(storage, expected);
+
+    // Reject a foreign image as soon as its first block is in, not after the whole carousel
+    bool headerChecked = false;
+    auto checkHeader = [&]() -> POTAError {
+        if (headerChecked || !assembler.hasBlock(0)) return POTAError::SUCCESS;
+        headerChecked = true;
+        uint8_t header[16];
+        size_t n = assembler.blockLength(0) < sizeof(header) ? assembler.blockLength(0) : sizeof(header);
+        if (!storage.read(0, header, n)) return POTAError::OTA_FAILED;
+        return checkImageHeader(header, n);
+    };
+
+    WiFiUDP udp;
+    if (!udp.beginMulticast(_mcastGroup, _mcastPort)) return POTAError::CONNECTION_FAILED;
+    Serial.println("📡 Listening for multicast firmware...");
+
+    // --- Collect blocks from the carousel ---
+    uint8_t packet[POTA_MCAST_HEADER_SIZE + POTA_MCAST_MAX_BLOCK_SIZE];
+    unsigned long start = millis();
+    unsigned long lastProgress = start;
+    while (!assembler.complete() && millis() - start < _mcastTimeoutMs) {
+        if (_holdTransfer && !waitWhilePaused()) {
+            udp.stop();
+            return POTAError::DOWNLOAD_CANCELLED;
+        }
+        if (udp.parsePacket() <= 0) {
+            if (millis() - lastProgress > POTA_MCAST_IDLE_TIMEOUT_MS) break; // Carousel silent
+            idle(1);
+            continue;
+        }
+        int n = udp.read(packet, sizeof(packet));
+        if (n <= 0) continue;
+        cooperate(n);
+        POTAMcastAssembler::Result result = assembler.onPacket(packet, n);
+        if (result == POTAMcastAssembler::Result::FAILED) {
+            udp.stop();
+            return POTAError::OTA_WRITE_FAILED;
+        }
+        if (result == POTAMcastAssembler::Result::STORED || result == POTAMcastAssembler::Result::RECOVERED) {
+            lastProgress = millis();
+            POTAError err = checkHeader();
+            if (err != POTAError::SUCCESS) {
+                udp.stop();
+                return err;
+            }
+        }
+    }
+    udp.stop();
+
+    if (!assembler.started()) return POTAError::PEER_NOT_FOUND;
+    Serial.printf("📡 Multicast: %lu/%lu blocks (%lu repaired by FEC)\n",
+                  (unsigned long)assembler.receivedBlocks(), (unsigned long)assembler.blockCount(),
+                  (unsigned long)assembler.recoveredBlocks());
+
+    // --- Fill what the carousel did not deliver with unicast Range requests ---
+    if (!assembler.complete()) {
+        POTAError err = fillMulticastGaps(assembler, url);
+        if (err == POTAError::SUCCESS) err = checkHeader(); // Block 0 may have come by unicast
+        if (err != POTAError::SUCCESS) return err;
+    }
+
+    // --- Verify the assembled image before making it bootable ---
+    POTASha256 sha;
+    uint8_t buffer[POTA_STREAM_BUFFER_SIZE];
+    for (uint32_t offset = 0; offset < assembler.imageSize(); ) {
+        uint32_t n = assembler.imageSize() - offset;
+        if (n > sizeof(buffer)) n = sizeof(buffer);
+        if (!storage.read(offset, buffer, n)) return POTAError::OTA_FAILED;
+        sha.update(buffer, n);
+        offset += n;
+    }
+    uint8_t digest[POTA_SHA256_SIZE];
+    sha.finish(digest);
+    if (memcmp(digest, expected, sizeof(digest)) != 0) {
+        Serial.println("❌ Image checksum mismatch");
+        return POTAError::OTA_CHECKSUM_MISMATCH;
+    }
+
+    _writtenPartition = partition; // Made bootable (or staged) by completeUpdate()
+    return POTAError::SUCCESS;
+}
+#endif
+
+// -------------------- Peer Seeding (ESP32) --------------------
+#if defined(ESP32)
+void POTA::setPeerFetch(bool enabled) {
+    _peerFetch = enabled;
+}
+
+
+bool POTA::startMDNS() {
+    static bool started = false;
+    if (started) return true;
+
+    // Hostname derived from the MAC, e.g. pota-a1b2c3d4e5f6
+    uint8_t mac[6];
+    esp_efuse_mac_get_default(mac);
+    char hostname[24];
+    snprintf(hostname, sizeof(hostname), "pota-%02x%02x%02x%02x%02x%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    started = MDNS.begin(hostname);
+    return started;
+}
+
+POTAError POTA::beginSeeder(uint16_t port) {
+    if (_seederActive) return POTAError::SUCCESS;
+    if (strlen(_deviceType) == 0) return POTAError::CLIENT_NOT_INITIALIZED;
+
+    Serial.println("🔍 Hashing running firmware for seeding...");
+    if (hashRunningImage() != POTAError::SUCCESS) return POTAError::SEEDER_START_FAILED;
+    if (!startMDNS()) return POTAError::SEEDER_START_FAILED;
+
+    if (!MDNS.addService("pota", "tcp", port)) return POTAError::SEEDER_START_FAILED;
+    MDNS.addServiceTxt("pota", "tcp", "type", _deviceType);
+    MDNS.addServiceTxt("pota", "tcp", "ver", _firmwareVersion);
+    MDNS.addServiceTxt("pota", "tcp", "sha", _runningChecksum);
+
+    _seederServer.begin(port);
+    _seederActive = true;
+    Serial.print("🌱 Seeding firmware ");
+    Serial.print(_firmwareVersion);
+    Serial.print(" on port ");
+    Serial.println(port);
+    return POTAError::SUCCESS;
+}
+
+void POTA::endSeeder() {
+    if (!_seederActive) return;
+    _seederClient.stop();
+    _seederServer.end();
+    mdns_service_remove("_pota", "_tcp");
+    _seederActive = false;
+}
+
+bool POTA::readSeederRequest() {
+    // --- Collect the request head as it arrives ---
+    uint8_t buffer[128];
+    int avail;
+    while (_seederRequest.state() == POTASeederParse::INCOMPLETE && (avail = _seederClient.available()) > 0) {
+        int n = _seederClient.read(buffer, avail < (int)sizeof(buffer) ? avail : sizeof(buffer));
+        if (n <= 0) break;
+        _seederRequest.feed(buffer, n);
+    }
+    if (_seederRequest.state() == POTASeederParse::INCOMPLETE) {
+        // Bare connects (peer RTT probes) and stalled peers must not hold the seeder
+        if (millis() - _seederAcceptedAt >= POTA_SEEDER_REQUEST_TIMEOUT_MS) _seederClient.stop();
+        return false;
+    }
+    if (_seederRequest.state() == POTASeederParse::INVALID) {
+        _seederClient.stop();
+        return false;
+    }
+
+    // --- Answer it ---
+    uint32_t first = 0;
+    uint32_t last = 0;
+    int status = _seederRequest.resolve(_runningImageSize, first, last);
+    char header[320];
+    size_t len = POTASeederRequest::formatHeader(header, sizeof(header), status, first, last,
+                                                 _runningImageSize, _runningChecksum);
+    _seederOffset = 0;
+    _seederEnd = 0;
+    if (status == 200 || status == 206) {
+        _seederOffset = first;
+        _seederEnd = _seederRequest.head() ? first : last + 1;
+    }
+    _seederRequest.reset();
+    if (len == 0 || _seederClient.write((const uint8_t*)header, len) != len) {
+        _seederClient.stop();
+        return false;
+    }
+    _seederResponding = true;
+    return true;
+}
+
+void POTA::serveSeeder() {
+    // --- Accept a new peer when idle ---
+    if (!_seederClient.connected()) {
+        _seederClient.stop();
+        _seederClient = _seederServer.available();
+        if (!_seederClient) return;
+        _seederRequest.reset();
+        _seederResponding = false;
+        _seederAcceptedAt = millis();
+    }
+    if (!_seederResponding && !readSeederRequest()) return;
+
+    // --- Send the next slice of the running image ---
+    if (_seederOffset >= _seederEnd) {
+        _seederClient.stop();
+        return;
+    }
+    uint8_t buffer[POTA_STREAM_BUFFER_SIZE];
+    uint32_t n = _seederEnd - _seederOffset;
+    if (n > sizeof(buffer)) n = sizeof(buffer);
+    if (esp_partition_read(esp_ota_get_running_partition(), _seederOffset, buffer, n) != ESP_OK ||
+        _seederClient.write(buffer, n) != n) {
+        _seederClient.stop();
+        return;
+    }
+    _seederOffset += n;
+}
+
+POTAError POTA::fetchFromPeer() {
+    if (!POTASha256::isHexDigest(_update.checksum)) return POTAError::PEER_NOT_FOUND;
+    if (!startMDNS()) return POTAError::PEER_NOT_FOUND;
+
+    // --- Discover seeders advertising the signed checksum ---
+    int count = MDNS.queryService("pota", "tcp");
+    IPAddress bestIP;
+    uint16_t bestPort = 0;
+    unsigned long bestRtt = 0;
+    for (int i = 0; i < count; ++i) {
+        if (!MDNS.txt(i, "sha").equalsIgnoreCase(_update.checksum)) continue;
+    #if ESP_ARDUINO_VERSION_MAJOR >= 3
+        IPAddress ip = MDNS.address(i);
+    #else
+        IPAddress ip = MDNS.IP(i);
+    #endif
+        uint16_t port = MDNS.port(i);
+        if (ip == WiFi.localIP()) continue;
+
+        // Probe with a TCP connect; the quickest handshake wins
+        WiFiClient probe;
+        unsigned long t0 = micros();
+        if (!probe.connect(ip, port)) continue;
+        unsigned long rtt = micros() - t0;
+        probe.stop();
+        if (bestPort == 0 || rtt < bestRtt) {
+            bestIP = ip;
+            bestPort = port;
+            bestRtt = rtt;
+        }
+    }
+    if (bestPort == 0) return POTAError::PEER_NOT_FOUND;
+
+    char url[64];
+    snprintf(url, sizeof(url), "http://%s:%u" POTA_SEEDER_PATH, bestIP.toString().c_str(), bestPort);
+    Serial.print("🤝 Downloading firmware from peer: ");
+    Serial.println(url);
+    _unmetered = true; // LAN traffic does not count against the data budget
+    POTAError err = streamImage(url, _update.checksum);
+    _unmetered = false;
+    return err;
+}
+#endif
+
 const char* POTA::errorToString(POTAError err) {
     switch (err) {
         case POTAError::SUCCESS: return "SUCCESS";
@@ -474,6 +3377,20 @@ const char* POTA::errorToString(POTAError err) {
         case POTAError::BUFFER_OVERFLOW_RESPONSE: return "Buffer overflow while reading server response";
         case POTAError::OTA_WIFI_FW_MISSING: return "Wi-Fi firmware not installed. Please run WifiFirmwareUpdater.ino / QSPIFormat.ino at least once before performing OTA.";
         case POTAError::SERVER_ERROR_4XX: return "Server returned a 4xx error";
+        case POTAError::OTA_CHECKSUM_MISMATCH: return "Firmware image does not match the signed checksum";
+        case POTAError::OTA_WRITE_FAILED: return "Failed to write firmware image to flash";
+        case POTAError::SEEDER_START_FAILED: return "Failed to start LAN seeder";
+        case POTAError::PEER_NOT_FOUND: return "No LAN peer advertises the requested firmware";
+        case POTAError::TIMESTAMP_INVALID: return "Server timestamp outside the accepted window";
+        case POTAError::NO_STAGED_UPDATE: return "No staged update to apply";
+        case POTAError::IMAGE_TOO_LARGE: return "Firmware image does not fit the update storage";
+        case POTAError::IMAGE_INCOMPATIBLE: return "Firmware image does not match this board";
+        case POTAError::ALREADY_RUNNING: return "Advertised firmware is already running";
+        case POTAError::DOWNLOAD_CANCELLED: return "Download cancelled";
+        case POTAError::DOWNLOAD_DEFERRED: return "Download deferred until the link improves";
+        case POTAError::DATA_BUDGET_EXCEEDED: return "Data budget of this billing period exceeded";
+        case POTAError::SOURCE_READ_FAILED: return "Local image source could not be read";
+        case POTAError::OPERATION_IN_PROGRESS: return "A check or update is already running";
         default: return "Undefined error";
     }
 }
\ No newline at end of file
@@ -33,11 +33,17 @@
     #include <WiFiClientSecure.h>
     #include <esp_mac.h> 
     #include <esp_https_ota.h>
+    #include <esp_ota_ops.h>
+    #include <ESPmDNS.h>
+    #include <Update.h>
+    #include <lwip/dns.h>
+    #include <lwip/sockets.h>
 #elif defined(ESP8266)
     #include <WiFiClientSecure.h>
     #include <ESP8266WiFi.h>
     #include <ESP8266httpUpdate.h>
     #include <CertStoreBearSSL.h>
+    #include <eboot_command.h>
 #elif defined(ARDUINO_OPTA)
     #include <WiFi.h>
     #include <WiFiSSLClient.h>
@@ -46,6 +52,75 @@
     #error "Unsupported platform! Please compile for ESP32 or Arduino Opta."
 #endif
 
+#include "POTACrypto.h"
+#include "POTAMulticast.h"
+#include "POTASeeder.h"
+#include "POTACoroutine.h"
+
+#ifndef POTA_RESPONSE_BUFFER_SIZE
+#define POTA_RESPONSE_BUFFER_SIZE 1536       ///< Buffer for the request body and the server response
+#endif
+#ifndef POTA_DNS_TTL_MS
+#define POTA_DNS_TTL_MS 600000UL             ///< Lifetime of a cached API_HOST address (ESP32)
+#endif
+#ifndef POTA_DNS_REFRESH_MARGIN_MS
+#define POTA_DNS_REFRESH_MARGIN_MS 60000UL   ///< loop() re-resolves this long before expiry
+#endif
+#ifndef POTA_TIME_MAX_SKEW_S
+#define POTA_TIME_MAX_SKEW_S 2               ///< Clock error tolerated before it is stepped to server time
+#endif
+#ifndef POTA_TIME_REPLAY_WINDOW_S
+#define POTA_TIME_REPLAY_WINDOW_S 300        ///< Maximum age of an accepted server timestamp
+#endif
+#ifndef POTA_TLS_CHECK_BUFFER
+#define POTA_TLS_CHECK_BUFFER 512            ///< ESP8266 TLS receive buffer for the update check (MFLN)
+#endif
+#ifndef POTA_TLS_DOWNLOAD_BUFFER
+#define POTA_TLS_DOWNLOAD_BUFFER 4096        ///< ESP8266 TLS receive buffer for image downloads (MFLN)
+#endif
+#ifndef POTA_TLS_TX_BUFFER
+#define POTA_TLS_TX_BUFFER 512               ///< ESP8266 TLS transmit buffer
+#endif
+#ifndef POTA_NOTES_EXCERPT_SIZE
+#define POTA_NOTES_EXCERPT_SIZE 128          ///< Release notes kept in POTAUpdateInfo (truncated)
+#endif
+#ifndef POTA_LOCAL_READ_SIZE
+#define POTA_LOCAL_READ_SIZE 4096            ///< Read size of local image sources (a flash sector)
+#endif
+#ifndef POTA_THROTTLE_MIN_BURST
+#define POTA_THROTTLE_MIN_BURST 2048         ///< Smallest token bucket size of the download rate limiter
+#endif
+#ifndef POTA_LINK_PROBE_BYTES
+#define POTA_LINK_PROBE_BYTES 16384          ///< Bytes measured before a download's duration is projected
+#endif
+#ifndef POTA_LINK_RETRY_MS
+#define POTA_LINK_RETRY_MS 300000UL          ///< Minimum wait before loop() flags a deferred update for retry
+#endif
+#ifndef POTA_TLS_HANDSHAKE_BYTES
+#define POTA_TLS_HANDSHAKE_BYTES 5500        ///< Estimated traffic of one TLS handshake, charged to the data budget
+#endif
+#ifndef POTA_DATA_RESERVE_PERCENT
+#define POTA_DATA_RESERVE_PERCENT 10         ///< Share of the data budget full-size downloads leave for polling
+#endif
+#ifndef POTA_PROFILE_EXTRA_MA
+#define POTA_PROFILE_EXTRA_MA 40             ///< Extra supply current assumed while the performance profile is active
+#endif
+#ifndef POTA_CANARY_METRICS
+#define POTA_CANARY_METRICS 4                ///< Application metrics compared by the post-update canary (max 8)
+#endif
+#ifndef POTA_CHUNK_MAX_SIZE
+#define POTA_CHUNK_MAX_SIZE 4096             ///< Largest verified chunk (held in RAM until it matches)
+#endif
+#ifndef POTA_CHUNK_MAX_COUNT
+    #if defined(ESP8266)
+        #define POTA_CHUNK_MAX_COUNT 256     ///< Most chunk hashes kept for one image (32 bytes of RAM each)
+    #else
+        #define POTA_CHUNK_MAX_COUNT 1024    ///< Most chunk hashes kept for one image (32 bytes of RAM each)
+    #endif
+#endif
+#define POTA_MANIFEST_SIZE 512               ///< Maximum length of the signed update manifest
+#define POTA_MAX_MIRRORS 4                   ///< Maximum mirrors taken from the manifest
+
 /**
  * @brief Enum for all possible errors returned by POTA library functions.
  */
@@ -77,7 +152,158 @@ enum class POTAError {
     BUFFER_OVERFLOW_REQUEST,        ///< Buffer overflow while building JSON request
     BUFFER_OVERFLOW_RESPONSE,      	///< Buffer overflow while reading server response
     CERTIFICATE_MISSING,             ///< Certificate not found in secure element
-    SERVER_ERROR_4XX                ///< Server error code 4xx
+    SERVER_ERROR_4XX,               ///< Server error code 4xx
+    OTA_CHECKSUM_MISMATCH,          ///< Downloaded image does not match the signed checksum
+    OTA_WRITE_FAILED,               ///< Writing the image to flash failed
+    SEEDER_START_FAILED,            ///< LAN seeder could not be started
+    PEER_NOT_FOUND,                 ///< No LAN peer advertises the requested image
+    TIMESTAMP_INVALID,              ///< Signed server timestamp is stale or predates the firmware
+    NO_STAGED_UPDATE,               ///< applyStagedUpdate() called without a staged update
+    IMAGE_TOO_LARGE,                ///< Image does not fit the inactive partition or free storage
+    IMAGE_INCOMPATIBLE,             ///< Image targets another chip, flash size or flash mode
+    ALREADY_RUNNING,                ///< The advertised image is the one already running (no-op)
+    DOWNLOAD_CANCELLED,             ///< The download was stopped by cancel()
+    DOWNLOAD_DEFERRED,              ///< Link too weak or slow for the download, retried from loop()
+    DATA_BUDGET_EXCEEDED,           ///< The data budget of this billing period cannot cover the transfer
+    SOURCE_READ_FAILED,             ///< The local image source could not be opened or read
+    OPERATION_IN_PROGRESS           ///< Called from the thread running the check or update, or while a coroutine one runs
+};
+
+/**
+ * @brief Transfer statistics of the last OTA download.
+ */
+struct POTAStats {
+    uint32_t downloadBytes = 0;     ///< Image bytes received by the last download
+    uint32_t downloadTimeMs = 0;    ///< Duration of the last download in milliseconds
+    uint32_t downloadRateBps = 0;   ///< Average throughput of the last download in bytes/s
+    bool downloadSecure = false;    ///< Whether the last download used TLS
+    uint32_t dnsTimeMs = 0;         ///< Time the last check spent resolving API_HOST (0 on a cache hit; ESP32 only)
+    uint32_t tlsBufferBytes = 0;    ///< TLS buffer RAM of the last ESP8266 connection (0 elsewhere)
+    uint32_t rateLimitBps = 0;      ///< Rate limit in force when the last download ended (0 = unlimited)
+    uint32_t throttleDelayMs = 0;   ///< Time the last download spent waiting on the rate limiter
+    uint32_t predictedTimeMs = 0;   ///< Projected duration of the last download (0 if not measured)
+    int32_t linkRssi = 0;           ///< RSSI in dBm sampled by the last link policy check
+    uint32_t profileTimeMs = 0;     ///< Time spent in the performance profile by the last check or update
+    uint32_t profileSavedMs = 0;    ///< Estimated download time saved against the last unboosted download
+    uint32_t profileEnergyUah = 0;  ///< Estimated extra charge spent in the profile (POTA_PROFILE_EXTRA_MA)
+    uint32_t yieldCount = 0;        ///< Yield points (and hook calls) during the last download
+    uint32_t yieldMaxGapUs = 0;     ///< Longest time between two yield points during the last download
+    uint32_t localTimeMs = 0;       ///< Wall-clock time of the last local update (read, verify and write)
+    uint32_t localNetworkMs = 0;    ///< Estimated time of that image over the last measured network rate (0 if unknown)
+};
+
+/**
+ * @brief Traffic of the current billing period, persisted across reboots.
+ *
+ * Byte counts are HTTP payload plus an estimate of POTA_TLS_HANDSHAKE_BYTES
+ * per TLS connection; LAN peer downloads are not counted.
+ */
+struct POTADataUsage {
+    uint32_t period = 0;            ///< Billing period (months since 1970, 0 while the clock is unset)
+    uint32_t checkBytes = 0;        ///< Bytes spent on update checks
+    uint32_t downloadBytes = 0;     ///< Bytes spent on image downloads
+    uint16_t checks = 0;            ///< Update checks made
+    uint16_t downloads = 0;         ///< Downloads started
+};
+
+/**
+ * @brief When a download is worth starting or continuing (see POTA::setLinkPolicy()).
+ */
+struct POTALinkPolicy {
+    int32_t minRssi = -127;                  ///< Defer when the RSSI is below this (dBm)
+    uint32_t maxTransferMs = 0;              ///< Defer when the projected duration exceeds this (0 = no budget)
+    uint32_t probeBytes = POTA_LINK_PROBE_BYTES; ///< Bytes measured before projecting the duration
+    /// Optional hook replacing the two thresholds: return false to defer.
+    /// predictedMs is 0 for the check made before the transfer starts.
+    bool (*accept)(int32_t rssi, uint32_t predictedMs) = nullptr;
+};
+
+/**
+ * @brief Signed description of an available update, filled by POTA::checkForUpdate().
+ */
+struct POTAUpdateInfo {
+    bool available = false;                    ///< An update is available
+    char version[32] = "";                     ///< Firmware version offered
+    char url[256] = "";                        ///< Image URL
+    char checksum[POTA_SHA256_HEX_SIZE] = "";  ///< Hex SHA-256 of the image (may be empty)
+    uint32_t size = 0;                         ///< Image size in bytes (0 if not advertised)
+    char notes[POTA_NOTES_EXCERPT_SIZE] = "";  ///< Release notes excerpt
+    char manifest[POTA_MANIFEST_SIZE] = "";    ///< Signed manifest ("key=value;...")
+};
+
+/**
+ * @brief Outcome of the post-update canary (see POTA::setCanaryWindow()).
+ */
+enum class POTACanaryState : uint8_t {
+    NONE = 0,       ///< No update to validate or report
+    VALIDATING,     ///< New firmware is inside its validation window
+    PASSED,         ///< Metrics held up against the previous image
+    REGRESSED,      ///< Metrics regressed and no rollback was possible
+    ROLLED_BACK     ///< Metrics regressed (or the update did not stick): previous image running
+};
+
+/**
+ * @brief Application hook called between download chunks (see POTA::setYieldHook()).
+ */
+typedef void (*POTAYieldHook)(void* arg);
+
+/**
+ * @brief Destination of a streamed firmware image (see POTA::setUpdateSink()).
+ *
+ * The download pipeline (Range resume, mirrors, rate limit, chunk and
+ * SHA-256 verification) writes the image through this interface, in
+ * order. The last write only happens once the whole image has matched
+ * the signed checksum. POTASink.h provides sinks for external flash,
+ * downstream MCUs and files.
+ */
+class POTAUpdateSink {
+public:
+    virtual ~POTAUpdateSink() {}
+    virtual POTAError begin(size_t size) = 0;                  ///< Prepare for an image of `size` bytes
+    virtual bool write(const uint8_t* data, size_t len) = 0;   ///< Append image bytes; false on failure
+    virtual POTAError finalize(const uint8_t* digest) = 0;     ///< Complete the image; `digest` is its verified SHA-256
+    virtual void abort() = 0;                                  ///< Discard a partially written image
+    virtual size_t capacity() { return SIZE_MAX; }             ///< Largest image the sink can take
+    virtual bool isLocal() const { return false; }             ///< The image is firmware for this device
+};
+
+/**
+ * @brief Local storage holding an image and its signed descriptor (see POTA::performLocalUpdate()).
+ *
+ * The descriptor is a reply of the update server (or one built with
+ * extras/local/gen_descriptor.py) and is verified with the same HMAC
+ * as checkForUpdate(). POTASource.h provides file and raw-block sources.
+ */
+class POTAUpdateSource {
+public:
+    virtual ~POTAUpdateSource() {}
+    virtual size_t readDescriptor(char* out, size_t outSize) = 0; ///< Signed descriptor JSON, at most outSize - 1 bytes, NUL-terminated; returns its length (0 if missing)
+    virtual POTAError open(size_t& size) = 0;                     ///< Open the image and report its size
+    virtual size_t read(uint8_t* buffer, size_t len) = 0;         ///< Next image bytes; fewer than `len` only on error
+    virtual void close() = 0;                                     ///< Release the image
+};
+
+/**
+ * @brief Default sink: the OTA target of this device.
+ *
+ * ESP32: inactive OTA partition (Update); ESP8266: Updater; Arduino
+ * Opta: LZSS update file on QSPI, decompressed by finalize(). Images
+ * written here pass the platform header checks and are activated (or
+ * staged) after finalize().
+ */
+class POTAOtaSink : public POTAUpdateSink {
+public:
+    POTAError begin(size_t size) override;
+    bool write(const uint8_t* data, size_t len) override;
+    POTAError finalize(const uint8_t* digest) override;
+    void abort() override;
+    size_t capacity() override;
+    bool isLocal() const override { return true; }
+
+#if defined(ARDUINO_OPTA)
+private:
+    FILE* _file = nullptr;   ///< Open update file
+#endif
 };
 
 /**
@@ -133,16 +359,407 @@ public:
 
     /**
      * @brief Check for available OTA update and perform it if available.
+     *
+     * Reboots into the new firmware, unless setStagedUpdates() is enabled.
      * @return POTAError code indicating success or failure
      */
     POTAError checkAndPerformOTA();
 
+    /**
+     * @brief Ask the server whether an update is available, without downloading it.
+     * @param info Filled with the HMAC-verified update description
+     * @return POTAError::SUCCESS if an update is available, NO_UPDATE_AVAILABLE if not, or an error
+     */
+    POTAError checkForUpdate(POTAUpdateInfo& info);
+
+    /**
+     * @brief Download and install an update returned by checkForUpdate().
+     *
+     * Reboots into the new firmware, unless setStagedUpdates() is enabled.
+     * @param info Update description
+     * @return POTAError code indicating success or failure
+     */
+    POTAError performUpdate(const POTAUpdateInfo& info);
+
+    /**
+     * @brief Install an update from local storage (SD card, USB mass storage, LittleFS).
+     *
+     * The source's descriptor must carry a valid server token for this
+     * device's secret; the image is then read in POTA_LOCAL_READ_SIZE
+     * blocks, checked against the signed checksum and written to the
+     * update sink, so the transfer runs at flash-write speed. Wall-clock
+     * time is reported in POTAStats::localTimeMs. Does not need Wi-Fi.
+     * @param source Image and descriptor
+     * @return POTAError code indicating success or failure
+     */
+    POTAError performLocalUpdate(POTAUpdateSource& source);
+
+#if defined(__cpp_impl_coroutine)
+    /**
+     * @brief Coroutine version of checkForUpdate().
+     *
+     * Suspends while the server prepares its reply, so other coroutines
+     * of `executor` run meanwhile. `info` must outlive the task.
+     * @param info Filled with the HMAC-verified update description
+     * @param executor Executor pumped from the sketch loop()
+     * @return Awaitable POTAError, as checkForUpdate()
+     */
+    POTATask<POTAError> co_checkForUpdate(POTAUpdateInfo& info, POTAExecutor& executor);
+
+    /**
+     * @brief Coroutine version of performUpdate().
+     *
+     * The image is streamed from the update URL and then the signed
+     * mirrors in manifest order. The coroutine suspends while it waits
+     * for response or body data, after each flash write, and while
+     * paused or throttled, so the other coroutines of `executor` run
+     * meanwhile. Connecting, the TLS handshake and the chunk-list fetch
+     * still block. LAN peers, multicast, compact images and the
+     * platform download libraries are not used, so the descriptor must
+     * carry a SHA-256 checksum (OTA_CHECKSUM_MISMATCH otherwise).
+     * Checks and updates started from coroutines run one at a time; while
+     * one is in progress the blocking checkForUpdate(), performUpdate()
+     * and performLocalUpdate() return OPERATION_IN_PROGRESS.
+     * @param info Update description (must outlive the task)
+     * @param executor Executor pumped from the sketch loop()
+     * @return Awaitable POTAError, as performUpdate()
+     */
+    POTATask<POTAError> co_performUpdate(const POTAUpdateInfo& info, POTAExecutor& executor);
+#endif
+
     /**
      * @brief Get the unique, secure MAC address of the device.
      * @return MAC address as a String
      */
     String getSecureMACAddress();
 
+    /**
+     * @brief Service background tasks (LAN seeder and DNS refresh on ESP32, canary, deferred-update retry flag). Call from the sketch loop().
+     */
+    void loop();
+
+    /**
+     * @brief Allow the signed update URL to point to a plain-HTTP mirror.
+     *
+     * Off by default. When enabled, an `http://` URL in a verified check
+     * response is accepted as long as it comes with a SHA-256 checksum.
+     * The image is then streamed without TLS, hashed while it is written,
+     * and only activated if its digest matches the HMAC-verified checksum.
+     * @param enabled true to accept plain-HTTP mirrors
+     */
+    void setAllowPlainHttp(bool enabled);
+
+    /**
+     * @brief Set the device clock from the HMAC-verified server timestamp.
+     *
+     * Off by default. When enabled, no NTP sync is needed before the first
+     * check: on ESP8266 certificates are validated against the firmware
+     * build date until the clock is set. The clock is stepped when it is
+     * unset or off by more than POTA_TIME_MAX_SKEW_S. Responses older than
+     * the firmware, or more than POTA_TIME_REPLAY_WINDOW_S older than the
+     * clock or the newest timestamp seen, are rejected with TIMESTAMP_INVALID.
+     * @param enabled true to use the server as a time source
+     */
+    void setTimeFromServer(bool enabled);
+
+    /**
+     * @brief Download and verify updates without activating them.
+     *
+     * When enabled, a successful update is written to the inactive slot
+     * and left there: the device keeps booting the running firmware,
+     * even across unplanned resets, until applyStagedUpdate() is called
+     * or the maintenance window opens. The staged state is persisted and
+     * restored by begin() as long as the same firmware is running.
+     * Checking again for the same update does not download it twice.
+     * @param enabled true to stage updates instead of rebooting into them
+     */
+    void setStagedUpdates(bool enabled);
+
+    /**
+     * @brief Apply a staged update automatically from loop() between two local hours.
+     *
+     * Needs a set clock (e.g. setTimeFromServer()). The window may wrap
+     * past midnight (e.g. 22 to 4); equal hours mean the whole day.
+     * Pass -1 to disable automatic activation.
+     * @param startHour First hour of the window (0-23)
+     * @param endHour Hour at which the window closes (0-23)
+     */
+    void setMaintenanceWindow(int8_t startHour, int8_t endHour);
+
+    /**
+     * @brief Whether a verified update is staged and waiting for activation.
+     */
+    bool hasStagedUpdate() const;
+
+    /**
+     * @brief Activate the staged update (reboots on success).
+     * @return POTAError::NO_STAGED_UPDATE if nothing is staged, or an apply error
+     */
+    POTAError applyStagedUpdate();
+
+    /**
+     * @brief Cap the firmware download rate so OTA leaves room for application traffic.
+     *
+     * Token bucket applied to every download path; it may be changed at
+     * any time, including from another task while a download is running.
+     * The achieved rate is reported in getStats().downloadRateBps.
+     * On Arduino Opta a limit routes downloads through the streaming path,
+     * which needs a hex checksum in the update descriptor.
+     * @param bytesPerSecond Maximum average rate in bytes/s (0 = unlimited)
+     */
+    void setDownloadRateLimit(uint32_t bytesPerSecond);
+
+    /**
+     * @brief Current download rate limit in bytes/s (0 = unlimited).
+     */
+    uint32_t getDownloadRateLimit() const;
+
+    /**
+     * @brief Stop the running download; performUpdate() returns DOWNLOAD_CANCELLED.
+     *
+     * Only sets a flag, so it is safe to call from another task or from
+     * work deferred out of an ISR. The connection is closed after the
+     * chunk being read (at most the HTTP timeout while a server has not
+     * answered yet) and the boot partition is never changed. A streamed image keeps what it has
+     * written: the next performUpdate() of the same image resumes it.
+     * @return true if a download was running
+     */
+    bool cancel();
+
+    /**
+     * @brief Hold the running download until resume() or cancel().
+     *
+     * Streamed downloads close their connection and continue with an HTTP
+     * Range request on resume; the esp_https_ota and ESPhttpUpdate paths
+     * stop reading and keep their connection open. Safe to call from
+     * another task or from work deferred out of an ISR.
+     * @return true if a download was running
+     */
+    bool pause();
+
+    /**
+     * @brief Continue a download held by pause().
+     */
+    void resume();
+
+    /**
+     * @brief Whether the running download is paused.
+     */
+    bool isPaused() const;
+
+    /**
+     * @brief Defer downloads the link cannot carry within budget.
+     *
+     * The RSSI is checked before the transfer starts, and the duration is
+     * projected from the throughput of the first probeBytes. A deferred
+     * update returns DOWNLOAD_DEFERRED and keeps the progress of a
+     * streamed image. Once POTA_LINK_RETRY_MS has passed and the RSSI is
+     * back above minRssi and no worse than at deferral, loop() clears
+     * isDeferred() and sets isRetryDue(); the application then calls
+     * retryDeferredUpdate() (or performUpdate()) when a download, and the
+     * reboot that may follow, suits it.
+     * The projection is in getStats().predictedTimeMs; the actual duration
+     * is getStats().downloadTimeMs. Arduino Opta only applies the RSSI check
+     * to its blocking library download.
+     * @param policy Thresholds and optional hook (defaults disable deferral)
+     */
+    void setLinkPolicy(const POTALinkPolicy& policy);
+
+    /**
+     * @brief Whether an update is deferred and waiting for a better link.
+     */
+    bool isDeferred() const;
+
+    /**
+     * @brief Whether a deferred update may be retried now that the link has recovered.
+     */
+    bool isRetryDue() const;
+
+    /**
+     * @brief performUpdate() of the update that was deferred.
+     * @return NO_UPDATE_AVAILABLE unless isRetryDue(), else as performUpdate()
+     */
+    POTAError retryDeferredUpdate();
+
+    /**
+     * @brief Cap the traffic POTA may use per billing period (metered links).
+     *
+     * Checks that no longer fit, and downloads larger than what is left,
+     * return DATA_BUDGET_EXCEEDED until the next period starts. With a
+     * budget set, an ESP8266 prefers a compact image when the manifest
+     * offers one: compact_url is the same firmware.bin compressed with
+     * gzip (RFC 1952, e.g. `gzip -9 -k firmware.bin`), which eboot
+     * inflates when installing; compact_size and compact_checksum are
+     * the byte count and SHA-256 of that .bin.gz file. ESP32 (raw app
+     * images only) and Opta (images already LZSS-compressed) always
+     * download the full image. A full-size image must also leave
+     * POTA_DATA_RESERVE_PERCENT of the budget for polling; without a
+     * signed size it is streamed and judged by its Content-Length
+     * before anything is written (which needs a signed checksum).
+     * Periods roll over on the billing day once the clock is set.
+     * @param bytesPerPeriod Budget in bytes (0 = unlimited, accounting only)
+     * @param billingDay Day of the month a period starts (1-28)
+     */
+    void setDataBudget(uint32_t bytesPerPeriod, uint8_t billingDay = 1);
+
+    /**
+     * @brief Traffic of the current billing period.
+     * @return Reference to the usage counters
+     */
+    const POTADataUsage& getDataUsage();
+
+    /**
+     * @brief Clear the counters of the current billing period.
+     */
+    void resetDataUsage();
+
+    /**
+     * @brief Run update checks and downloads at full speed.
+     *
+     * While a check or update runs, the CPU is raised to its highest clock
+     * and Wi-Fi power save is disabled (light/modem sleep on ESP8266). On
+     * ESP32 builds with power management, PM locks are held instead of
+     * changing the clock. On Opta, deep sleep is locked out. The previous
+     * settings are restored afterwards. getStats() reports the time spent,
+     * the estimated extra charge and the time saved against the last
+     * download made without the profile.
+     * @param enabled true to enable the profile
+     */
+    void setPerformanceProfile(bool enabled);
+
+    /**
+     * @brief Call an application function between download chunks.
+     *
+     * The hook runs (after yield()) at the cadence set by setYieldInterval(),
+     * between chunks and while waiting for data, rate limiting or resume().
+     * Connection setup and TLS handshakes are single blocking calls; the
+     * longest gap, including those, is reported as getStats().yieldMaxGapUs.
+     * On Arduino Opta, a hook routes downloads through the streaming path,
+     * which needs a hex checksum.
+     * @param hook Function to call (nullptr = only yield())
+     * @param arg Argument passed to the hook
+     */
+    void setYieldHook(POTAYieldHook hook, void* arg = nullptr);
+
+    /**
+     * @brief How often downloads yield and call the hook.
+     *
+     * A yield happens once either limit is reached; with both 0 (default),
+     * at every chunk and every millisecond of waiting.
+     * @param everyBytes Bytes received between yields (0 = no byte limit)
+     * @param everyUs Microseconds between yields (0 = no time limit)
+     */
+    void setYieldInterval(uint32_t everyBytes, uint32_t everyUs);
+
+    /**
+     * @brief Validate new firmware against application metrics after an update.
+     *
+     * Metrics reported with recordCanaryMetric() are averaged while an image
+     * runs; the averages become the baseline when an update is activated.
+     * The new image compares its own averages at the end of the window and
+     * a regression beyond a metric's threshold rolls back to the previous
+     * A/B slot on ESP32 (reported only on ESP8266 and Opta, which have no
+     * second slot). The outcome is sent with the next update check.
+     * Call before begin()/beginClient() in both images.
+     * @param windowMs Validation window after boot (0 = canary off)
+     */
+    void setCanaryWindow(uint32_t windowMs);
+
+    /**
+     * @brief Declare a canary metric and its regression threshold.
+     * @param index Metric slot (0 to POTA_CANARY_METRICS - 1)
+     * @param maxRegressionPercent Worst tolerated change against the baseline, in percent
+     * @param higherIsBetter true for e.g. free heap or throughput, false for e.g. loop time
+     */
+    void setCanaryMetric(uint8_t index, float maxRegressionPercent, bool higherIsBetter = false);
+
+    /**
+     * @brief Report a sample of a canary metric (call regularly from the application).
+     * @param index Metric slot
+     * @param value Sample value
+     */
+    void recordCanaryMetric(uint8_t index, float value);
+
+    /**
+     * @brief State of the post-update canary.
+     */
+    POTACanaryState getCanaryState() const;
+
+    /**
+     * @brief Send downloaded images to another destination than this device's OTA target.
+     *
+     * Images for a sink that is not local (see POTAUpdateSink::isLocal())
+     * are streamed, verified against the signed checksum and handed to
+     * finalize(); this device is neither rebooted nor staged, and the
+     * multicast, LAN peer and compact-image sources are skipped. A
+     * partially downloaded image for the previous sink is discarded.
+     * @param sink Destination, or nullptr for the built-in POTAOtaSink
+     * @return false (sink unchanged) while a download is running
+     */
+    bool setUpdateSink(POTAUpdateSink* sink);
+
+    /**
+     * @brief Statistics of the last OTA download (size, duration, throughput, TLS).
+     * @return Reference to the statistics
+     */
+    const POTAStats& getStats() const;
+
+    /**
+     * @brief Progress of the running (or last) download.
+     *
+     * Safe to call from the yield hook. From another thread, read it
+     * through POTAShared::status() instead.
+     * @param received Image bytes received so far
+     * @param total Image size (0 until known)
+     */
+    void getProgress(uint32_t& received, uint32_t& total) const;
+
+#if defined(ESP32)
+    /**
+     * @brief Serve the running firmware image to LAN neighbours.
+     *
+     * The image is served by ranged HTTP on the given port and advertised
+     * via mDNS (`_pota._tcp`) with its version and SHA-256 checksum.
+     * Requests are served incrementally from loop().
+     * @param port TCP port to listen on
+     * @return POTAError result of the operation
+     */
+    POTAError beginSeeder(uint16_t port = POTA_SEEDER_DEFAULT_PORT);
+
+    /**
+     * @brief Stop serving the firmware image and withdraw the mDNS advertisement.
+     */
+    void endSeeder();
+
+    /**
+     * @brief Enable or disable fetching updates from LAN seeders.
+     *
+     * When enabled, checkAndPerformOTA() first downloads the image from the
+     * fastest LAN peer advertising the signed checksum, verifies it, and
+     * falls back to the cloud URL on any failure.
+     * @param enabled true to try LAN peers before the cloud
+     */
+    void setPeerFetch(bool enabled);
+
+    /**
+     * @brief Enable or disable the multicast receive mode of the OTA download.
+     *
+     * When enabled, the image is first collected from a UDP multicast
+     * carousel (see extras/multicast), repairing lost blocks with the
+     * carousel's XOR FEC blocks. Remaining gaps are fetched from the OTA
+     * URL with HTTP Range requests, and the assembled image is only made
+     * bootable if its SHA-256 matches the signed checksum.
+     * @param enabled true to listen for a multicast carousel
+     * @param group Multicast group address
+     * @param port UDP port
+     * @param timeoutMs Maximum time spent listening to the carousel
+     */
+    void setMulticastReceive(bool enabled,
+                             const char* group = POTA_MCAST_DEFAULT_GROUP,
+                             uint16_t port = POTA_MCAST_DEFAULT_PORT,
+                             uint32_t timeoutMs = 300000);
+#endif
+
 private:
 #if defined(ESP32) || defined(ESP8266)
     WiFiClientSecure* _client = nullptr;  ///< Pointer to ESP32/ESP8266 secure Wi-Fi client
@@ -154,6 +771,111 @@ private:
     char _firmwareVersion[32];   ///< Current firmware version
     char _authToken[64];         ///< Authentication token
     char _serverSecret[65];      ///< Secret key for server token generation
+    POTAUpdateInfo _update;              ///< Update being checked or installed
+    bool _allowPlainHttp = false;        ///< Accept signed plain-HTTP mirror URLs
+    bool _timeFromServer = false;        ///< Bootstrap the clock from the server timestamp
+    bool _stageUpdates = false;          ///< Stage updates instead of rebooting into them
+    bool _staged = false;                ///< A verified update waits for activation
+    char _stagedChecksum[POTA_SHA256_HEX_SIZE] = ""; ///< Checksum of the staged update
+    int8_t _windowStart = -1;            ///< Maintenance window start hour (-1 = off)
+    int8_t _windowEnd = -1;              ///< Maintenance window end hour
+#if defined(ESP32)
+    const esp_partition_t* _stagedPartition = nullptr; ///< Slot holding the staged image
+    const esp_partition_t* _writtenPartition = nullptr; ///< Slot filled by receiveMulticast(), activated by completeUpdate()
+#elif defined(ESP8266)
+    eboot_command _stagedCommand;        ///< Bootloader copy command held back until apply
+#endif
+    int64_t _lastServerTime = 0;         ///< Newest server timestamp accepted (persisted)
+    POTAStats _stats;                    ///< Statistics of the last download
+    volatile uint32_t _rateLimitBps = 0; ///< Download rate limit in bytes/s (0 = unlimited)
+    int64_t _bucketTokens = 0;           ///< Rate limiter credit in byte-milliseconds
+    volatile bool _transferActive = false;  ///< performUpdate() is running
+    volatile bool _cancelRequested = false; ///< cancel() was called during this transfer
+    volatile bool _pauseRequested = false;  ///< pause() is in effect
+    volatile bool _holdTransfer = false;    ///< Either of the above: download loops must stop reading
+    POTASha256 _streamSha;               ///< Digest of the streamed image, kept across a cancel
+    char _partialChecksum[POTA_SHA256_HEX_SIZE] = ""; ///< Image of a cancelled streamed transfer
+    uint32_t _partialWritten = 0;        ///< Bytes of it already in the update partition
+    uint32_t _partialTotal = 0;          ///< Its full size
+    POTALinkPolicy _linkPolicy;          ///< Deferral thresholds and hook
+    bool _linkProbed = false;            ///< Throughput of the running download has been judged
+    volatile bool _linkRejected = false; ///< The running download was judged too slow
+    bool _deferred = false;              ///< An update waits for a better link
+    int32_t _deferredRssi = 0;           ///< RSSI when it was deferred
+    uint32_t _deferRetryAt = 0;          ///< millis() before which loop() does not flag it for retry
+    bool _retryDue = false;              ///< The link recovered: the deferred update may be retried
+    POTADataUsage _usage;                ///< Traffic of the current billing period
+    bool _usageLoaded = false;           ///< _usage has been read from POTAStore
+    bool _unmetered = false;             ///< The running download is on the LAN (not counted)
+    uint32_t _dataBudget = 0;            ///< Bytes allowed per billing period (0 = unlimited)
+    uint8_t _billingDay = 1;             ///< Day of the month a billing period starts
+    bool _performanceProfile = false;    ///< Boost CPU and radio during checks and updates
+    uint32_t _baselineRateBps = 0;       ///< Throughput of the last download without the profile
+    POTAYieldHook _yieldHook = nullptr;  ///< Application hook called between chunks
+    void* _yieldArg = nullptr;           ///< Argument of _yieldHook
+    uint32_t _yieldEveryBytes = 0;       ///< Bytes between yields (0 = no byte limit)
+    uint32_t _yieldEveryUs = 0;          ///< Microseconds between yields (0 = no time limit)
+    uint32_t _yieldPendingBytes = 0;     ///< Bytes received since the last yield
+    uint32_t _lastYieldUs = 0;           ///< micros() of the last yield
+    uint32_t _canaryWindowMs = 0;        ///< Post-update validation window (0 = off)
+    uint32_t _canaryEndsAt = 0;          ///< millis() at which the window closes
+    POTACanaryState _canaryState = POTACanaryState::NONE; ///< Canary outcome awaiting report
+    uint8_t _canaryMetrics = 0;          ///< Bitmask of declared metrics
+    uint8_t _canaryHigherBetter = 0;     ///< Bitmask of metrics where higher is better
+    float _canaryLimit[POTA_CANARY_METRICS] = {};  ///< Tolerated regression per metric (percent)
+    float _canaryMean[POTA_CANARY_METRICS] = {};   ///< Running average per metric under this image
+    uint32_t _canaryCount[POTA_CANARY_METRICS] = {}; ///< Samples per metric under this image
+    uint8_t* _chunkHashes = nullptr;     ///< Verified chunk hashes of the image being downloaded
+    uint8_t* _chunkBuffer = nullptr;     ///< One chunk, held until its hash matches
+    uint32_t _chunkCount = 0;            ///< Entries in _chunkHashes
+    uint32_t _chunkSize = 0;             ///< Bytes per chunk (the last one may be shorter)
+    uint32_t _bucketStamp = 0;           ///< millis() of the last bucket refill
+    POTAOtaSink _otaSink;                ///< Built-in destination of downloaded images
+    POTAUpdateSink* _sink = &_otaSink;   ///< Current destination of downloaded images
+    size_t _checkTraffic = 0;            ///< Request bytes of the update check in flight
+    volatile uint32_t _progressBytes = 0; ///< Image bytes received by the running download
+    volatile uint32_t _progressTotal = 0; ///< Its size (0 until known)
+    bool _checkCanary = false;           ///< That request carried a canary report
+#if defined(__cpp_impl_coroutine)
+    bool _coBusy = false;                ///< A coroutine check or update is running
+#endif
+
+#if defined(ESP32)
+    IPAddress _dnsAddress;               ///< Cached API_HOST address
+    bool _dnsValid = false;              ///< _dnsAddress holds a usable (possibly stale) address
+    bool _dnsLoaded = false;             ///< RTC copy of the cache has been read
+    uint32_t _dnsExpiresAt = 0;          ///< millis() at which the cached address expires
+    uint32_t _dnsRetryAt = 0;            ///< millis() before which a failed refresh is not retried
+    volatile uint8_t _dnsLookup = 0;     ///< State of the background lookup (set from the lwIP thread)
+    volatile uint32_t _dnsLookupResult = 0; ///< Address it found
+#endif
+
+#if defined(ESP8266)
+    bool _mflnProbed = false;            ///< MFLN support of API_HOST is known
+    bool _mflnSupported = false;         ///< API_HOST accepts Maximum Fragment Length negotiation
+#endif
+
+#if defined(ESP32) || defined(ESP8266)
+    uint32_t _runningImageSize = 0;      ///< Size of the running image in bytes
+    char _runningChecksum[POTA_SHA256_HEX_SIZE]; ///< SHA-256 of the running image
+#endif
+
+#if defined(ESP32)
+    bool _peerFetch = false;             ///< Try LAN seeders before the cloud
+    bool _seederActive = false;          ///< Seeder is listening
+    WiFiServer _seederServer;            ///< Seeder HTTP server
+    WiFiClient _seederClient;            ///< Peer currently being served
+    POTASeederRequest _seederRequest;    ///< Its request, received without blocking loop()
+    unsigned long _seederAcceptedAt = 0; ///< When the peer was accepted
+    bool _seederResponding = false;      ///< Headers sent, streaming the requested range
+    uint32_t _seederOffset = 0;          ///< Next image offset to send
+    uint32_t _seederEnd = 0;             ///< End (exclusive) of the requested range
+
+    bool _mcastEnabled = false;          ///< Listen for a multicast carousel first
+    IPAddress _mcastGroup;               ///< Multicast group address
+    uint16_t _mcastPort = POTA_MCAST_DEFAULT_PORT; ///< Multicast UDP port
+    uint32_t _mcastTimeoutMs = 0;        ///< Maximum time spent on the carousel
+#endif
 
     /**
      * @brief Generate a secure token to verify OTA update from server.
@@ -164,6 +886,7 @@ private:
      * @param protocol_version Protocol version string
      * @param notes Release notes
      * @param timestamp Server timestamp
+     * @param manifest Signed manifest (empty when the server sent none)
      * @param secret Secret key
      * @param outToken Output buffer for token
      * @param outTokenSize Size of output buffer
@@ -176,16 +899,72 @@ private:
                                   const char* protocol_version,
                                   const char* notes,
                                   const char* timestamp,
+                                  const char* manifest,
                                   const char* secret,
                                   char* outToken, size_t outTokenSize);
 
     /**
-     * @brief Check the server for OTA update availability.
-     * @param outOTAUrl Buffer to store OTA URL if update is available
-     * @param outOTAUrlSize Size of output buffer
-     * @return POTAError indicating success or type of failure
+     * @brief Connect to the server and send the update check request (first half of checkForUpdate()).
      */
-    POTAError checkOTAUpdate(char* outOTAUrl, size_t outOTAUrlSize);
+    POTAError sendUpdateCheck(POTAUpdateInfo& info);
+
+    /**
+     * @brief Read and verify the reply to sendUpdateCheck() (second half of checkForUpdate()).
+     */
+    POTAError receiveUpdateCheck(POTAUpdateInfo& info);
+
+    /**
+     * @brief True while a coroutine check or update owns the client (always false without coroutines).
+     */
+    bool coroutineActive() const;
+
+#if defined(__cpp_impl_coroutine)
+    /**
+     * @brief True while no coroutine check or update is running (POTAExecutor::until() condition).
+     */
+    static bool coIdle(void* self);
+
+    /**
+     * @brief Body of co_performUpdate(), run once no other coroutine check or update is active.
+     */
+    POTATask<POTAError> co_transferUpdate(const POTAUpdateInfo& info, POTAExecutor& executor);
+
+    /**
+     * @brief Coroutine version of streamImage(): the same steps, suspending instead of waiting.
+     */
+    POTATask<POTAError> co_streamImage(const char* const* urls, size_t urlCount,
+                                       const char* expectedChecksum, POTAExecutor& executor);
+#endif
+
+    /**
+     * @brief Checks shared by every update path before a transfer starts.
+     *
+     * Skips an image that is already staged or running, runs the
+     * preflight and link checks and drops a staged image the transfer
+     * would overwrite.
+     * @param result Result to return when the update stops here
+     * @return true if the transfer should go ahead
+     */
+    bool prepareUpdate(POTAError& result);
+
+    /**
+     * @brief Parse a signed update reply (server response or local descriptor) and verify its token.
+     * @param json Reply, parsed in place
+     * @param info Filled with the signed fields; `available` mirrors the reply's "update"
+     * @param timestamp Signed server timestamp
+     * @return POTAError::SUCCESS if the token matches, or an error
+     */
+    POTAError parseSignedUpdate(char* json, POTAUpdateInfo& info, long& timestamp);
+
+    /**
+     * @brief Read and verify a local source's signed descriptor into _update (first half of performLocalUpdate()).
+     */
+    POTAError loadLocalDescriptor(POTAUpdateSource& source);
+
+    /**
+     * @brief Copy an image from a local source to the update sink, verifying it on the way.
+     */
+    POTAError readLocalImage(POTAUpdateSource& source);
 
     /**
      * @brief Perform the OTA update using the provided URL.
@@ -193,5 +972,366 @@ private:
      * @return POTAError indicating success or type of failure
      */
     POTAError performOTA(const char* OTA_file_url);
-    
+
+    /**
+     * @brief Stream a firmware image over HTTP(S) into the update partition.
+     *
+     * The image is hashed while it is written and only activated if its
+     * SHA-256 matches the expected checksum. Interrupted transfers are
+     * resumed with HTTP Range requests, including one stopped by cancel().
+     * With chunk hashes loaded, each chunk is verified before it is
+     * written and a corrupted chunk alone is fetched again.
+     * @param url http:// or https:// URL of the image
+     * @param expectedChecksum Hex SHA-256 the image must match
+     * @return POTAError indicating success or type of failure
+     */
+    POTAError streamImage(const char* url, const char* expectedChecksum);
+
+    /**
+     * @brief Stream a firmware image from the first source that delivers it.
+     *
+     * Sources are tried in order; when one fails mid-transfer the next one
+     * resumes it with an HTTP Range request.
+     * @param urls Candidate image URLs, preferred first
+     * @param urlCount Number of URLs
+     * @param expectedChecksum Hex SHA-256 the image must match
+     * @param usedSource Optional output: index of the source that completed the image
+     * @return POTAError indicating success or type of failure
+     */
+    POTAError streamImage(const char* const* urls, size_t urlCount,
+                          const char* expectedChecksum, size_t* usedSource = nullptr);
+
+    // --- Steps of a streamed transfer, shared by streamImage() and co_streamImage() ---
+    enum class StreamStep : uint8_t;
+    struct StreamState;
+
+    void streamStart(StreamState& s);                           ///< Reset the download, or pick up a cancelled one
+    POTAError streamKeepPartial(StreamState& s, POTAError reason); ///< Keep the progress so a later call can continue
+    StreamStep streamConnect(StreamState& s, POTAError& err);   ///< Pick a source, connect and send the GET
+    StreamStep streamAccept(StreamState& s, int status, long contentLength, long rangeStart,
+                            POTAError& err);                    ///< Check the response head and begin the sink
+    size_t streamWant(const StreamState& s) const;              ///< Bytes to read next (rest of the chunk or buffer)
+    StreamStep streamConsume(StreamState& s, size_t received, POTAError& err); ///< Verify and write received bytes
+    POTAError streamFinish(StreamState& s, size_t* usedSource); ///< Finalize a complete image
+#if defined(__cpp_impl_coroutine)
+    bool streamWaiting(StreamState& s, unsigned long since);    ///< No data yet, still connected and not timed out
+#endif
+
+    /**
+     * @brief Download the image from the fastest of the primary URL and the signed mirrors.
+     * @param primaryUrl URL advertised by the server
+     * @param mirrorList "|"-separated mirror URLs from the manifest (modified in place)
+     * @return POTAError indicating success or type of failure
+     */
+    POTAError downloadFromMirrors(const char* primaryUrl, char* mirrorList);
+
+    /**
+     * @brief Check a verified server timestamp against the replay window and set the clock.
+     * @param serverTime Server timestamp in Unix seconds
+     * @return POTAError::SUCCESS or TIMESTAMP_INVALID
+     */
+    POTAError applyServerTime(long serverTime);
+
+#if defined(ESP8266)
+    /**
+     * @brief Size the BearSSL buffers for the next connection.
+     *
+     * Uses small buffers when the server supports Maximum Fragment Length
+     * negotiation (probed once for API_HOST and cached), a small buffer
+     * for the update check and a larger one for bulk downloads.
+     * @param host Host that will be connected to
+     * @param bulk true for an image download, false for the update check
+     */
+    void configureTlsBuffers(const char* host, bool bulk);
+#endif
+
+#if defined(ESP32)
+    /**
+     * @brief Resolve API_HOST through the cache.
+     *
+     * Returns the cached address while it is fresh, otherwise resolves it
+     * again; on resolver failure the last known good address is used.
+     * @param address Output address
+     * @return true if an address is available
+     */
+    bool resolveApiHost(IPAddress& address);
+
+    /**
+     * @brief Resolve API_HOST now (blocking) and update the cache and dnsTimeMs.
+     * @return true if the lookup succeeded
+     */
+    bool refreshDns();
+
+    /**
+     * @brief Collect a finished background lookup and, shortly before the cached
+     *        address expires, start the next one. Never blocks.
+     */
+    void refreshDnsIfDue();
+
+    /**
+     * @brief Cache a freshly resolved address.
+     */
+    void storeDnsAddress(const IPAddress& address);
+
+    /**
+     * @brief Restore the cached address from RTC memory.
+     */
+    void loadDnsRecord();
+
+    /**
+     * @brief Copy the cached address to RTC memory.
+     */
+    void saveDnsRecord();
+
+    static void dnsLookupStart(void* arg);                                        ///< lwIP thread: start the lookup
+    static void dnsLookupDone(const char* name, const ip_addr_t* address, void* arg); ///< lwIP thread: lookup result
+#endif
+
+    /**
+     * @brief Store size, duration and throughput of a finished download in the stats.
+     * @param bytes Image bytes received
+     * @param elapsedMs Transfer duration in milliseconds
+     */
+    void recordDownload(uint32_t bytes, uint32_t elapsedMs);
+
+    /**
+     * @brief Wait out a pause() with the download stopped.
+     * @return false if the download was cancelled
+     */
+    bool waitWhilePaused();
+
+    /**
+     * @brief Drop the progress of a cancelled streamed transfer.
+     */
+    void discardPartial();
+
+    /**
+     * @brief Reset per-download state: token bucket, throttle and link statistics.
+     */
+    void beginDownload();
+
+    /**
+     * @brief Sample the RSSI and apply the link policy.
+     * @param predictedMs Projected download duration (0 = not measured yet)
+     * @return false if the download should be deferred
+     */
+    bool linkAcceptable(uint32_t predictedMs);
+
+    /**
+     * @brief Project the download duration once probeBytes have arrived.
+     * @param received Bytes received by this download so far
+     * @param total Bytes this download has to transfer (0 = unknown)
+     * @param startMs millis() when this download started
+     * @return true (once) if the projection fails the link policy
+     */
+    bool linkTooSlow(uint32_t received, uint32_t total, unsigned long startMs);
+
+    /**
+     * @brief Remember the update for a retry from loop().
+     * @return POTAError::DOWNLOAD_DEFERRED
+     */
+    POTAError deferUpdate();
+
+    /**
+     * @brief Count received bytes and charge them to the token bucket, waiting while it is in debt.
+     * @param bytes Bytes just received
+     */
+    void chargeDownload(size_t bytes);
+
+    /**
+     * @brief First half of chargeDownload(): count the bytes and charge the bucket, without waiting.
+     */
+    void countDownload(size_t bytes);
+
+    /**
+     * @brief Second half of chargeDownload(): wait while the bucket is in debt.
+     */
+    void throttle();
+
+    /**
+     * @brief Refill the token bucket and return the next slice to wait while it is in debt.
+     * @return Milliseconds to wait, 0 once the bucket is out of debt
+     */
+    uint32_t throttleDelay();
+
+    /**
+     * @brief Yield and call the application hook when the interval is due.
+     * @param bytes Bytes received since the previous call
+     */
+    void cooperate(size_t bytes);
+
+    /**
+     * @brief Wait without starving the application (yields every millisecond).
+     * @param ms Time to wait in milliseconds
+     */
+    void idle(uint32_t ms);
+
+    /**
+     * @brief Idle callback for socket waits: cooperates and reports a pause or cancel.
+     * @param self POTA instance
+     * @return true if the wait should be abandoned
+     */
+    static bool idleWait(void* self);
+
+    /**
+     * @brief Fetch the signed chunk-hash list of the update and check it against chunk_root.
+     *
+     * The manifest keys chunk_size, chunk_list (URL of the concatenated
+     * SHA-256 of every chunk) and chunk_root (SHA-256 of that list) enable
+     * per-chunk verification; without them only the image checksum is used.
+     * @return true if chunk hashes are loaded
+     */
+    bool loadChunkHashes();
+
+    /**
+     * @brief Release the chunk hashes and chunk buffer.
+     */
+    void freeChunkHashes();
+
+    /**
+     * @brief Whether a received chunk matches its signed hash.
+     * @param index Chunk number
+     * @param data Chunk bytes
+     * @param len Chunk length
+     */
+    bool chunkMatches(uint32_t index, const uint8_t* data, size_t len) const;
+
+    /**
+     * @brief Pick up the canary record at boot and open the validation window.
+     */
+    void resumeCanary();
+
+    /**
+     * @brief Store this image's metric averages as the baseline of the update being activated.
+     */
+    void saveCanaryBaseline();
+
+    /**
+     * @brief Compare the metrics at the end of the window; roll back on regression.
+     */
+    void evaluateCanary();
+
+    /**
+     * @brief JSON member reporting the canary outcome for the update check.
+     * @param out Output buffer (empty string when there is nothing to report)
+     * @param outSize Size of out
+     */
+    void canaryReport(char* out, size_t outSize);
+
+    /**
+     * @brief Load the usage counters and start a new billing period when due.
+     */
+    void loadUsage();
+
+    /**
+     * @brief Persist the usage counters.
+     */
+    void saveUsage();
+
+    /**
+     * @brief Charge the estimated cost of a TLS handshake to a phase.
+     * @param download true for download traffic, false for update checks
+     */
+    void chargeHandshake(bool download);
+
+    /**
+     * @brief Whether the remaining data budget can carry a transfer.
+     * @param bytes Expected traffic of the transfer
+     * @param keepReserve Also keep POTA_DATA_RESERVE_PERCENT of the budget free
+     */
+    bool dataBudgetAllows(uint32_t bytes, bool keepReserve);
+
+    /**
+     * @brief Reboot into the newly activated firmware.
+     */
+    void restartDevice();
+
+    /**
+     * @brief Check the signed size and header descriptor before any image byte is transferred.
+     *
+     * Uses the manifest keys `size`, `chip_id`, `flash_size` and
+     * `flash_mode` when present; downloads additionally peek at the
+     * image header and the announced Content-Length.
+     * @param info Update about to be installed
+     * @return POTAError::SUCCESS, IMAGE_TOO_LARGE or IMAGE_INCOMPATIBLE
+     */
+    POTAError preflightUpdate(const POTAUpdateInfo& info);
+
+    /**
+     * @brief Finish a verified update: stage it or activate it, depending on the policy.
+     * @return POTAError indicating success or type of failure
+     */
+    POTAError completeUpdate();
+
+    /**
+     * @brief Pick up an update staged before the last reset, if its slot still holds it.
+     */
+    void restoreStagedUpdate();
+
+    /**
+     * @brief Forget the staged update (applied, or about to be overwritten).
+     */
+    void dropStagedUpdate();
+
+    /**
+     * @brief Arm the bootloader for the new image (Opta) and reboot.
+     * @return POTAError indicating success or type of failure
+     */
+    POTAError activateUpdate();
+
+    /**
+     * @brief Whether the local time is inside the maintenance window.
+     */
+    bool inMaintenanceWindow() const;
+
+#if defined(ESP32) || defined(ESP8266)
+    /**
+     * @brief Hash the running image and cache its size and checksum.
+     *
+     * The result is persisted per partition and reused as long as the
+     * running build is unchanged, so the flash is only read once.
+     * @return POTAError indicating success or failure
+     */
+    POTAError hashRunningImage();
+#endif
+
+#if defined(ESP32)
+    /**
+     * @brief Start the mDNS responder under a MAC-derived hostname.
+     * @return true if the responder is running
+     */
+    bool startMDNS();
+
+    /**
+     * @brief Download the advertised update from the fastest LAN seeder.
+     * @return POTAError indicating success or type of failure
+     */
+    POTAError fetchFromPeer();
+
+    /**
+     * @brief Read what the peer sent so far and, once its request is complete, send the response headers.
+     * @return true once the response body can be sent
+     */
+    bool readSeederRequest();
+
+    /**
+     * @brief Accept seeder clients and send the next slice of the image.
+     */
+    void serveSeeder();
+
+    /**
+     * @brief Assemble and verify the advertised image from a multicast carousel; completeUpdate() activates it.
+     * @param url OTA URL used to fill gaps with Range requests
+     * @return POTAError indicating success or type of failure
+     */
+    POTAError receiveMulticast(const char* url);
+
+    /**
+     * @brief Fetch every block the carousel did not deliver via HTTP Range requests.
+     * @param assembler Multicast reassembly state
+     * @param url OTA URL of the image
+     * @return POTAError indicating success or type of failure
+     */
+    POTAError fillMulticastGaps(POTAMcastAssembler& assembler, const char* url);
+#endif
 };
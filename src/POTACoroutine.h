@@ -0,0 +1,289 @@
+/*
+  POTACoroutine.h - C++20 coroutine support for the POTA library
+  --------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air
+
+  Description:
+    A small single-threaded executor and an awaitable task type, so a
+    sketch can run POTA::co_checkForUpdate() / POTA::co_performUpdate()
+    next to its own coroutines without an RTOS task (and stack) each:
+
+      POTAExecutor executor;
+
+      POTATask<void> blink() {
+          for (;;) { toggleLed(); co_await executor.sleep(500); }
+      }
+      POTATask<void> ota() {
+          POTAUpdateInfo info;
+          if (co_await pota.co_checkForUpdate(info, executor) == POTAError::SUCCESS)
+              co_await pota.co_performUpdate(info, executor);
+      }
+
+      void setup() { ...; executor.spawn(blink()); executor.spawn(ota()); }
+      void loop()  { executor.pump(); }
+
+    Coroutines suspend on awaitables (sleep, socket readable, any
+    condition) that the executor polls on each pump(); nothing here
+    allocates besides the coroutine frames. Only compiled where the
+    toolchain implements coroutines (__cpp_impl_coroutine, e.g.
+    ESP32 Arduino 3.x with -std=gnu++20, or host builds).
+*/
+
+#pragma once
+
+#if defined(__cpp_impl_coroutine)
+
+#include <Arduino.h>
+#include <Client.h>
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+#ifndef POTA_CO_MAX_TASKS
+#define POTA_CO_MAX_TASKS 8   ///< Detached tasks an executor can own at once
+#endif
+
+template <typename T> class POTATask;
+
+// -------------------- Waiters --------------------
+/**
+ * @brief A suspended coroutine and the condition it waits for.
+ *
+ * Lives in the awaiting coroutine's frame and is linked into the
+ * executor's queue while suspended.
+ */
+class POTAWaiter {
+public:
+    virtual ~POTAWaiter() {}
+    virtual bool ready() = 0;                ///< Polled by POTAExecutor::pump()
+
+    std::coroutine_handle<> handle;          ///< Coroutine to resume
+    POTAWaiter* next = nullptr;              ///< Queue link
+};
+
+// -------------------- Executor --------------------
+/**
+ * @brief Single-threaded, cooperative coroutine executor.
+ */
+class POTAExecutor {
+public:
+    POTAExecutor() = default;
+    POTAExecutor(const POTAExecutor&) = delete;
+    POTAExecutor& operator=(const POTAExecutor&) = delete;
+    ~POTAExecutor();
+
+    /**
+     * @brief Start a task and own it until it finishes.
+     * @return false if POTA_CO_MAX_TASKS tasks are already running
+     */
+    bool spawn(POTATask<void>&& task);
+
+    /**
+     * @brief Resume every waiting coroutine whose condition holds. Call from loop().
+     *
+     * Not reentrant: coroutines suspend instead of pumping the executor.
+     */
+    void pump();
+
+    /**
+     * @brief Number of spawned tasks still running.
+     */
+    size_t tasks() const;
+
+    /**
+     * @brief Queue a waiter (used by the awaitables).
+     */
+    void enqueue(POTAWaiter* waiter);
+
+    // --- Awaitables ---
+    template <typename W>
+    struct Awaiter : W {
+        template <typename... A>
+        Awaiter(POTAExecutor& executor, A&&... args) : W(std::forward<A>(args)...), _executor(executor) {}
+        bool await_ready() { return W::ready(); }
+        void await_suspend(std::coroutine_handle<> h) { this->handle = h; _executor.enqueue(this); }
+        void await_resume() {}
+        POTAExecutor& _executor;
+    };
+
+    struct YieldWaiter : POTAWaiter {
+        bool _queued = false;
+        bool ready() override { return std::exchange(_queued, true); } ///< Runs on the next pump
+    };
+
+    struct SleepWaiter : POTAWaiter {
+        explicit SleepWaiter(uint32_t ms) : _start(millis()), _ms(ms) {}
+        bool ready() override { return millis() - _start >= _ms; }
+        uint32_t _start;
+        uint32_t _ms;
+    };
+
+    struct ReadableWaiter : POTAWaiter {
+        ReadableWaiter(Client& client, uint32_t timeoutMs) : _client(client), _start(millis()), _timeoutMs(timeoutMs) {}
+        bool ready() override {
+            return _client.available() || !_client.connected() || millis() - _start >= _timeoutMs;
+        }
+        Client& _client;
+        uint32_t _start;
+        uint32_t _timeoutMs;
+    };
+
+    struct UntilWaiter : POTAWaiter {
+        UntilWaiter(bool (*condition)(void*), void* ctx) : _condition(condition), _ctx(ctx) {}
+        bool ready() override { return _condition(_ctx); }
+        bool (*_condition)(void*);
+        void* _ctx;
+    };
+
+    /** @brief Let other coroutines run, continue on the next pump. */
+    Awaiter<YieldWaiter> yield() { return Awaiter<YieldWaiter>(*this); }
+
+    /** @brief Suspend for `ms` milliseconds. */
+    Awaiter<SleepWaiter> sleep(uint32_t ms) { return Awaiter<SleepWaiter>(*this, ms); }
+
+    /** @brief Suspend until `client` has data, disconnects or `timeoutMs` passes. */
+    Awaiter<ReadableWaiter> readable(Client& client, uint32_t timeoutMs) {
+        return Awaiter<ReadableWaiter>(*this, client, timeoutMs);
+    }
+
+    /** @brief Suspend until `condition(ctx)` returns true. */
+    Awaiter<UntilWaiter> until(bool (*condition)(void*), void* ctx) {
+        return Awaiter<UntilWaiter>(*this, condition, ctx);
+    }
+
+private:
+    POTAWaiter* _head = nullptr;             ///< Waiting coroutines, oldest first
+    POTAWaiter* _tail = nullptr;
+    size_t _waiting = 0;
+    std::coroutine_handle<> _owned[POTA_CO_MAX_TASKS] = {}; ///< Spawned task frames
+    YieldWaiter _start[POTA_CO_MAX_TASKS];   ///< First resume of each spawned task
+};
+
+// -------------------- Tasks --------------------
+/**
+ * @brief Lazily started coroutine producing a T; awaitable from another coroutine.
+ *
+ * Only a task returned by a coroutine may be awaited: a moved-from task
+ * (or one given to POTAExecutor::spawn()) is empty and must not be.
+ */
+template <typename T>
+class POTATask {
+public:
+    struct PromiseBase {
+        std::coroutine_handle<> continuation;  ///< Awaiting coroutine, resumed on completion
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            template <typename P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+                auto next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    struct ValuePromise : PromiseBase {
+        T value{};
+        void return_value(T v) { value = std::move(v); }
+        T result() { return std::move(value); }
+    };
+    struct VoidPromise : PromiseBase {
+        void return_void() {}
+        void result() {}
+    };
+    struct promise_type : std::conditional_t<std::is_void_v<T>, VoidPromise, ValuePromise> {
+        POTATask get_return_object() { return POTATask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+    POTATask(POTATask&& other) noexcept : _handle(std::exchange(other._handle, {})) {}
+    POTATask& operator=(POTATask&& other) noexcept {
+        if (this != &other) {
+            if (_handle) _handle.destroy();
+            _handle = std::exchange(other._handle, {});
+        }
+        return *this;
+    }
+    POTATask(const POTATask&) = delete;
+    POTATask& operator=(const POTATask&) = delete;
+    ~POTATask() { if (_handle) _handle.destroy(); }
+
+    // Awaiting a task starts it; the awaiting coroutine resumes when it finishes
+    bool await_ready() const noexcept { return _handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        _handle.promise().continuation = awaiting;
+        return _handle;
+    }
+    T await_resume() { return _handle.promise().result(); }
+
+    /**
+     * @brief Give up ownership of the frame (used by POTAExecutor::spawn()).
+     */
+    std::coroutine_handle<> release() { return std::exchange(_handle, {}); }
+
+private:
+    explicit POTATask(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+    std::coroutine_handle<promise_type> _handle;
+};
+
+// -------------------- Executor (inline) --------------------
+inline POTAExecutor::~POTAExecutor() {
+    for (auto& h : _owned) if (h) h.destroy();
+}
+
+inline void POTAExecutor::enqueue(POTAWaiter* waiter) {
+    waiter->next = nullptr;
+    if (_tail) _tail->next = waiter;
+    else _head = waiter;
+    _tail = waiter;
+    ++_waiting;
+}
+
+inline bool POTAExecutor::spawn(POTATask<void>&& task) {
+    for (size_t i = 0; i < POTA_CO_MAX_TASKS; ++i) {
+        if (_owned[i]) continue;
+        _owned[i] = task.release();
+        _start[i] = YieldWaiter();
+        _start[i]._queued = true; // Start on the next pump
+        _start[i].handle = _owned[i];
+        enqueue(&_start[i]);
+        return true;
+    }
+    return false;
+}
+
+inline void POTAExecutor::pump() {
+    // Only waiters queued before this pass are polled: resumed coroutines queue for the next one
+    for (size_t n = _waiting; n > 0 && _head; --n) {
+        POTAWaiter* waiter = _head;
+        _head = waiter->next;
+        if (!_head) _tail = nullptr;
+        --_waiting;
+        if (waiter->ready()) waiter->handle.resume();
+        else enqueue(waiter);
+    }
+
+    // Reap finished tasks
+    for (auto& h : _owned) {
+        if (h && h.done()) {
+            h.destroy();
+            h = nullptr;
+        }
+    }
+}
+
+inline size_t POTAExecutor::tasks() const {
+    size_t n = 0;
+    for (auto& h : _owned) if (h && !h.done()) ++n;
+    return n;
+}
+
+#endif // __cpp_impl_coroutine
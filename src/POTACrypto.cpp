@@ -0,0 +1,181 @@
+/*
+  POTACrypto.cpp - Hashing helpers for the POTA library
+  -----------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air/
+
+  Description:
+    Implementation of the incremental SHA-256 hasher and HMAC declared
+    in POTACrypto.h, on top of mbedtls (ESP32, Opta) or BearSSL (ESP8266).
+*/
+
+#include "POTACrypto.h"
+
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    #include <mbedtls/version.h>
+    // mbedtls 3 dropped the _ret suffix; 2.x (Opta, Arduino-ESP32 2.x) still has it
+    #if MBEDTLS_VERSION_MAJOR >= 3
+        #define POTA_SHA256_STARTS(ctx) mbedtls_sha256_starts(ctx, 0)
+        #define POTA_SHA256_UPDATE(ctx, data, len) mbedtls_sha256_update(ctx, data, len)
+        #define POTA_SHA256_FINISH(ctx, out) mbedtls_sha256_finish(ctx, out)
+    #else
+        #define POTA_SHA256_STARTS(ctx) mbedtls_sha256_starts_ret(ctx, 0)
+        #define POTA_SHA256_UPDATE(ctx, data, len) mbedtls_sha256_update_ret(ctx, data, len)
+        #define POTA_SHA256_FINISH(ctx, out) mbedtls_sha256_finish_ret(ctx, out)
+    #endif
+#endif
+
+// -------------------- POTASha256 --------------------
+POTASha256::POTASha256() {
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    mbedtls_sha256_init(&_ctx);
+#endif
+    begin();
+}
+
+POTASha256::~POTASha256() {
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    mbedtls_sha256_free(&_ctx);
+#endif
+}
+
+void POTASha256::begin() {
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    POTA_SHA256_STARTS(&_ctx);
+#elif defined(ESP8266)
+    br_sha256_init(&_ctx);
+#endif
+}
+
+void POTASha256::update(const uint8_t* data, size_t len) {
+    if (!data || len == 0) return;
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    POTA_SHA256_UPDATE(&_ctx, data, len);
+#elif defined(ESP8266)
+    br_sha256_update(&_ctx, data, len);
+#endif
+}
+
+void POTASha256::finish(uint8_t* out) {
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    POTA_SHA256_FINISH(&_ctx, out);
+#elif defined(ESP8266)
+    br_sha256_out(&_ctx, out);
+#endif
+}
+
+bool POTASha256::isHardware() {
+#if defined(ESP32) && defined(CONFIG_MBEDTLS_HARDWARE_SHA)
+    return true;
+#elif defined(ARDUINO_OPTA) && defined(MBEDTLS_SHA256_ALT)
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char* POTASha256::backendName() {
+#if defined(ESP32)
+    return isHardware() ? "mbedtls + ESP32 SHA peripheral" : "mbedtls (software)";
+#elif defined(ARDUINO_OPTA)
+    return isHardware() ? "mbedtls + STM32 HASH" : "mbedtls (software)";
+#elif defined(ESP8266)
+    return "BearSSL (software)";
+#else
+    return "none";
+#endif
+}
+
+void POTASha256::toHex(const uint8_t* digest, size_t len, char* outHex) {
+    static const char hexChars[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; ++i) {
+        outHex[i*2]     = hexChars[(digest[i] >> 4) & 0x0F];
+        outHex[i*2 + 1] = hexChars[digest[i] & 0x0F];
+    }
+    outHex[len * 2] = '\0';
+}
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool POTASha256::isHexDigest(const char* hex) {
+    if (!hex) return false;
+    for (size_t i = 0; i < POTA_SHA256_SIZE * 2; ++i) {
+        if (hexNibble(hex[i]) < 0) return false;
+    }
+    return hex[POTA_SHA256_SIZE * 2] == '\0';
+}
+
+bool POTASha256::fromHex(const char* hex, uint8_t* out) {
+    if (!isHexDigest(hex)) return false;
+    for (size_t i = 0; i < POTA_SHA256_SIZE; ++i) {
+        out[i] = (uint8_t)((hexNibble(hex[i*2]) << 4) | hexNibble(hex[i*2 + 1]));
+    }
+    return true;
+}
+
+bool POTASha256::matchesHex(const uint8_t* digest, const char* hex) {
+    uint8_t expected[POTA_SHA256_SIZE];
+    if (!fromHex(hex, expected)) return false;
+    return memcmp(expected, digest, POTA_SHA256_SIZE) == 0;
+}
+
+// -------------------- POTAHmacSha256 --------------------
+#if defined(ESP8266)
+// Not optimized away, unlike a memset() of memory that is about to die
+static void wipe(void* p, size_t len) {
+    volatile uint8_t* b = (volatile uint8_t*)p;
+    while (len--) *b++ = 0;
+}
+#endif
+
+POTAHmacSha256::POTAHmacSha256() {
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    mbedtls_md_init(&_ctx);
+    mbedtls_md_setup(&_ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+#elif defined(ESP8266)
+    wipe(&_key, sizeof(_key));
+    wipe(&_ctx, sizeof(_ctx));
+#endif
+}
+
+POTAHmacSha256::~POTAHmacSha256() {
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    mbedtls_md_free(&_ctx); // Zeroizes the pads
+#elif defined(ESP8266)
+    wipe(&_key, sizeof(_key));
+    wipe(&_ctx, sizeof(_ctx));
+#endif
+}
+
+void POTAHmacSha256::begin(const uint8_t* key, size_t keyLen) {
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    mbedtls_md_hmac_starts(&_ctx, key, keyLen);
+#elif defined(ESP8266)
+    br_hmac_key_init(&_key, &br_sha256_vtable, key, keyLen);
+    br_hmac_init(&_ctx, &_key, 0);
+#endif
+}
+
+void POTAHmacSha256::update(const uint8_t* data, size_t len) {
+    if (!data || len == 0) return;
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    mbedtls_md_hmac_update(&_ctx, data, len);
+#elif defined(ESP8266)
+    br_hmac_update(&_ctx, data, len);
+#endif
+}
+
+void POTAHmacSha256::finish(uint8_t* out) {
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    mbedtls_md_hmac_finish(&_ctx, out);
+#elif defined(ESP8266)
+    br_hmac_out(&_ctx, out);
+#endif
+}
@@ -0,0 +1,156 @@
+/*
+  POTACrypto.h - Hashing helpers for the POTA library
+  ---------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air
+
+  Description:
+    Incremental SHA-256 used by the POTA library to verify firmware
+    images while they are streamed, so that an image is only activated
+    when its digest matches the HMAC-verified `checksum` received
+    from the POTA service, and HMAC-SHA256 for the server token.
+
+  Backends (selected at compile time):
+    - ESP32 (all variants): mbedtls SHA-256, which the Arduino-ESP32
+      build routes to the SHA peripheral (CONFIG_MBEDTLS_HARDWARE_SHA)
+    - ESP8266: BearSSL, software
+    - Arduino Opta WiFi: mbedtls SHA-256, using the STM32 HASH unit
+      when the Mbed target provides MBEDTLS_SHA256_ALT, software otherwise
+
+    HMAC-SHA256 uses the platform implementation (mbedtls_md HMAC,
+    BearSSL br_hmac), whose inner hash is the same SHA-256 backend and
+    which wipes its key pads when released.
+
+    Every board has exactly one usable backend, so the selection is
+    made at compile time rather than through a runtime interface: the
+    hash runs once per streamed chunk and needs no virtual dispatch.
+    See examples/POTA_Hash_Benchmark for throughput.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    #include <mbedtls/sha256.h>
+    #include <mbedtls/md.h>
+#elif defined(ESP8266)
+    #include <bearssl/bearssl.h>
+#endif
+
+#define POTA_SHA256_SIZE 32      ///< Size of a SHA-256 digest in bytes
+#define POTA_SHA256_HEX_SIZE 65  ///< Size of a hex-encoded SHA-256 digest, including terminator
+
+/**
+ * @brief Incremental SHA-256 hasher.
+ */
+class POTASha256 {
+public:
+    POTASha256();
+    ~POTASha256();
+
+    /**
+     * @brief Start (or restart) a new digest.
+     */
+    void begin();
+
+    /**
+     * @brief Feed data into the digest.
+     * @param data Pointer to the data
+     * @param len Number of bytes
+     */
+    void update(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Finalize the digest.
+     * @param out Output buffer of POTA_SHA256_SIZE bytes
+     */
+    void finish(uint8_t* out);
+
+    /**
+     * @brief Whether this build hashes with a hardware accelerator.
+     */
+    static bool isHardware();
+
+    /**
+     * @brief Human-readable name of the active backend.
+     */
+    static const char* backendName();
+
+    /**
+     * @brief Hex-encode a binary digest (lowercase).
+     * @param digest Binary digest
+     * @param len Digest length in bytes
+     * @param outHex Output buffer of at least 2 * len + 1 bytes
+     */
+    static void toHex(const uint8_t* digest, size_t len, char* outHex);
+
+    /**
+     * @brief Compare a binary SHA-256 digest against a hex string (case-insensitive).
+     * @return true if the hex string encodes exactly the given digest
+     */
+    static bool matchesHex(const uint8_t* digest, const char* hex);
+
+    /**
+     * @brief Decode a hex SHA-256 digest into binary.
+     * @param hex Hex string of POTA_SHA256_SIZE * 2 characters
+     * @param out Output buffer of POTA_SHA256_SIZE bytes
+     * @return true if the string was a well-formed digest
+     */
+    static bool fromHex(const char* hex, uint8_t* out);
+
+    /**
+     * @brief Check whether a string is a well-formed hex SHA-256 digest.
+     */
+    static bool isHexDigest(const char* hex);
+
+private:
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    mbedtls_sha256_context _ctx; ///< mbedtls SHA-256 context (hardware-backed where available)
+#elif defined(ESP8266)
+    br_sha256_context _ctx;      ///< BearSSL SHA-256 context
+#endif
+
+    POTASha256(const POTASha256&) = delete;
+    POTASha256& operator=(const POTASha256&) = delete;
+};
+
+/**
+ * @brief Incremental HMAC-SHA256 (platform implementation).
+ */
+class POTAHmacSha256 {
+public:
+    POTAHmacSha256();
+    ~POTAHmacSha256(); ///< Wipes the key material
+
+    /**
+     * @brief Start a new MAC.
+     * @param key Secret key
+     * @param keyLen Key length in bytes
+     */
+    void begin(const uint8_t* key, size_t keyLen);
+
+    /**
+     * @brief Feed message data.
+     */
+    void update(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Finalize the MAC.
+     * @param out Output buffer of POTA_SHA256_SIZE bytes
+     */
+    void finish(uint8_t* out);
+
+private:
+#if defined(ESP32) || defined(ARDUINO_OPTA)
+    mbedtls_md_context_t _ctx;   ///< mbedtls HMAC context (holds the key pads)
+#elif defined(ESP8266)
+    br_hmac_key_context _key;    ///< BearSSL HMAC key (holds the key pads)
+    br_hmac_context _ctx;        ///< BearSSL HMAC context
+#endif
+
+    POTAHmacSha256(const POTAHmacSha256&) = delete;
+    POTAHmacSha256& operator=(const POTAHmacSha256&) = delete;
+};
@@ -0,0 +1,274 @@
+/*
+  POTAMulticast.h - Multicast firmware distribution protocol for POTA
+  -------------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air
+
+  Description:
+    Wire format and receive-side reassembly for carousel-broadcast
+    firmware images. The image is split into numbered blocks; every
+    group of `groupSize` blocks is followed by one XOR repair block,
+    so a receiver can rebuild any single lost block per group without
+    waiting for the next carousel cycle. Remaining gaps are filled by
+    the caller (e.g. with HTTP Range requests).
+
+    This header is platform independent: it is used by the POTA
+    library on the device and by the Linux sender and loopback
+    benchmark in extras/multicast.
+
+  Packet layout (big-endian, POTA_MCAST_HEADER_SIZE bytes + payload):
+      0  magic "POTM"          4
+      4  protocol version      1
+      5  type (data/repair)    1
+      6  group size (K)        2
+      8  image size            4
+     12  block or group index  4
+     16  payload length        2
+     18  block size            2
+     20  image SHA-256        32
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <new>
+
+#define POTA_MCAST_VERSION 1
+#define POTA_MCAST_HEADER_SIZE 52
+#define POTA_MCAST_MAX_BLOCK_SIZE 1400     ///< Largest payload that fits one Ethernet/Wi-Fi frame
+#define POTA_MCAST_DEFAULT_BLOCK_SIZE 1024
+#define POTA_MCAST_DEFAULT_GROUP_SIZE 16
+#define POTA_MCAST_DEFAULT_PORT 8071
+#define POTA_MCAST_DEFAULT_GROUP "239.255.80.84"
+
+/**
+ * @brief Packet types carried by the carousel.
+ */
+enum class POTAMcastType : uint8_t {
+    DATA = 0,   ///< One image block
+    REPAIR = 1  ///< XOR of all data blocks of one group
+};
+
+/**
+ * @brief Decoded packet header.
+ */
+struct POTAMcastHeader {
+    POTAMcastType type;
+    uint16_t groupSize;
+    uint32_t imageSize;
+    uint32_t index;
+    uint16_t payloadLen;
+    uint16_t blockSize;
+    uint8_t digest[32];
+};
+
+// -------------------- Encoding --------------------
+inline void potaMcastPut16(uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v; }
+inline void potaMcastPut32(uint8_t* p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+inline uint16_t potaMcastGet16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+inline uint32_t potaMcastGet32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief Serialize a header into the first POTA_MCAST_HEADER_SIZE bytes of a packet.
+ */
+inline void potaMcastEncodeHeader(const POTAMcastHeader& h, uint8_t* out) {
+    memcpy(out, "POTM", 4);
+    out[4] = POTA_MCAST_VERSION;
+    out[5] = (uint8_t)h.type;
+    potaMcastPut16(out + 6, h.groupSize);
+    potaMcastPut32(out + 8, h.imageSize);
+    potaMcastPut32(out + 12, h.index);
+    potaMcastPut16(out + 16, h.payloadLen);
+    potaMcastPut16(out + 18, h.blockSize);
+    memcpy(out + 20, h.digest, 32);
+}
+
+/**
+ * @brief Parse and sanity-check a packet header.
+ * @return true if the packet is a well-formed POTA multicast packet
+ */
+inline bool potaMcastDecodeHeader(const uint8_t* pkt, size_t len, POTAMcastHeader& h) {
+    if (len < POTA_MCAST_HEADER_SIZE || memcmp(pkt, "POTM", 4) != 0 || pkt[4] != POTA_MCAST_VERSION)
+        return false;
+    h.type = (POTAMcastType)pkt[5];
+    h.groupSize = potaMcastGet16(pkt + 6);
+    h.imageSize = potaMcastGet32(pkt + 8);
+    h.index = potaMcastGet32(pkt + 12);
+    h.payloadLen = potaMcastGet16(pkt + 16);
+    h.blockSize = potaMcastGet16(pkt + 18);
+    memcpy(h.digest, pkt + 20, 32);
+    if (h.type != POTAMcastType::DATA && h.type != POTAMcastType::REPAIR) return false;
+    if (h.groupSize == 0 || h.blockSize == 0 || h.blockSize > POTA_MCAST_MAX_BLOCK_SIZE) return false;
+    if (h.payloadLen > h.blockSize || len < (size_t)POTA_MCAST_HEADER_SIZE + h.payloadLen) return false;
+    return h.imageSize > 0;
+}
+
+/**
+ * @brief Random-access storage the reassembler writes blocks into.
+ */
+class POTAMcastStorage {
+public:
+    virtual ~POTAMcastStorage() {}
+    virtual bool begin(uint32_t imageSize) = 0;                           ///< Prepare (e.g. erase) storage
+    virtual bool write(uint32_t offset, const uint8_t* data, size_t len) = 0;
+    virtual bool read(uint32_t offset, uint8_t* data, size_t len) = 0;
+};
+
+/**
+ * @brief Receive-side reassembly of a carousel-broadcast image.
+ */
+class POTAMcastAssembler {
+public:
+    /**
+     * @brief Result of feeding one packet.
+     */
+    enum class Result {
+        IGNORED,     ///< Not part of the expected session
+        DUPLICATE,   ///< Already had this block
+        STORED,      ///< New data block stored
+        RECOVERED,   ///< Missing block rebuilt from a repair block
+        FAILED       ///< Storage error or out-of-memory
+    };
+
+    POTAMcastAssembler(POTAMcastStorage& storage, const uint8_t* expectedDigest)
+        : _storage(storage) {
+        memcpy(_digest, expectedDigest, sizeof(_digest));
+    }
+
+    ~POTAMcastAssembler() {
+        delete[] _bitmap;
+        delete[] _scratch;
+    }
+
+    /**
+     * @brief Feed one received datagram.
+     */
+    Result onPacket(const uint8_t* pkt, size_t len) {
+        POTAMcastHeader h;
+        if (!potaMcastDecodeHeader(pkt, len, h) || memcmp(h.digest, _digest, sizeof(_digest)) != 0)
+            return Result::IGNORED;
+        if (!_started && !start(h)) return Result::FAILED;
+        if (h.imageSize != _imageSize || h.blockSize != _blockSize || h.groupSize != _groupSize)
+            return Result::IGNORED;
+
+        const uint8_t* payload = pkt + POTA_MCAST_HEADER_SIZE;
+        if (h.type == POTAMcastType::DATA) {
+            if (h.index >= _blocks || h.payloadLen != blockLength(h.index)) return Result::IGNORED;
+            if (has(h.index)) return Result::DUPLICATE;
+            return store(h.index, payload, h.payloadLen) ? Result::STORED : Result::FAILED;
+        }
+
+        if (h.index >= groupCount() || h.payloadLen != _blockSize) return Result::IGNORED;
+        return repair(h.index, payload);
+    }
+
+    /**
+     * @brief Store a block obtained out of band (e.g. from a unicast Range fill).
+     */
+    bool fillBlock(uint32_t index, const uint8_t* data, size_t len) {
+        if (!_started || index >= _blocks || len != blockLength(index)) return false;
+        if (has(index)) return true;
+        return store(index, data, len);
+    }
+
+    /**
+     * @brief Find the next run of missing blocks at or after `from`.
+     * @return true if a run was found
+     */
+    bool nextMissingRun(uint32_t from, uint32_t& first, uint32_t& count) const {
+        for (uint32_t i = from; i < _blocks; ++i) {
+            if (has(i)) continue;
+            first = i;
+            count = 0;
+            while (i < _blocks && !has(i)) { ++count; ++i; }
+            return true;
+        }
+        return false;
+    }
+
+    bool started() const { return _started; }
+    bool hasBlock(uint32_t index) const { return _started && index < _blocks && has(index); }
+    bool complete() const { return _started && _received == _blocks; }
+    uint32_t imageSize() const { return _imageSize; }
+    uint16_t blockSize() const { return _blockSize; }
+    uint32_t blockCount() const { return _blocks; }
+    uint32_t receivedBlocks() const { return _received; }
+    uint32_t recoveredBlocks() const { return _recovered; }
+
+    /**
+     * @brief Length of a block (the last block may be short).
+     */
+    size_t blockLength(uint32_t index) const {
+        uint32_t offset = index * _blockSize;
+        return (_imageSize - offset < _blockSize) ? _imageSize - offset : _blockSize;
+    }
+
+private:
+    POTAMcastStorage& _storage;
+    uint8_t _digest[32];
+    bool _started = false;
+    uint32_t _imageSize = 0;
+    uint16_t _blockSize = 0;
+    uint16_t _groupSize = 0;
+    uint32_t _blocks = 0;
+    uint32_t _received = 0;
+    uint32_t _recovered = 0;
+    uint8_t* _bitmap = nullptr;    ///< One bit per received block
+    uint8_t* _scratch = nullptr;   ///< Two block buffers used during repair
+
+    bool start(const POTAMcastHeader& h) {
+        _imageSize = h.imageSize;
+        _blockSize = h.blockSize;
+        _groupSize = h.groupSize;
+        _blocks = (_imageSize + _blockSize - 1) / _blockSize;
+        _bitmap = new (std::nothrow) uint8_t[(_blocks + 7) / 8]();
+        _scratch = new (std::nothrow) uint8_t[2 * (size_t)_blockSize];
+        if (!_bitmap || !_scratch || !_storage.begin(_imageSize)) return false;
+        _started = true;
+        return true;
+    }
+
+    uint32_t groupCount() const { return (_blocks + _groupSize - 1) / _groupSize; }
+    bool has(uint32_t i) const { return _bitmap[i >> 3] & (1 << (i & 7)); }
+
+    bool store(uint32_t index, const uint8_t* data, size_t len) {
+        if (!_storage.write(index * _blockSize, data, len)) return false;
+        _bitmap[index >> 3] |= (1 << (index & 7));
+        ++_received;
+        return true;
+    }
+
+    // Rebuild the single missing block of a group: repair XOR every other block
+    Result repair(uint32_t group, const uint8_t* payload) {
+        uint32_t first = group * _groupSize;
+        uint32_t last = first + _groupSize;
+        if (last > _blocks) last = _blocks;
+
+        uint32_t missing = _blocks;
+        for (uint32_t i = first; i < last; ++i) {
+            if (has(i)) continue;
+            if (missing != _blocks) return Result::DUPLICATE; // More than one gap: wait for the carousel
+            missing = i;
+        }
+        if (missing == _blocks) return Result::DUPLICATE;
+
+        uint8_t* acc = _scratch;
+        uint8_t* block = _scratch + _blockSize;
+        memcpy(acc, payload, _blockSize);
+        for (uint32_t i = first; i < last; ++i) {
+            if (i == missing) continue;
+            size_t len = blockLength(i);
+            if (!_storage.read(i * _blockSize, block, len)) return Result::FAILED;
+            for (size_t b = 0; b < len; ++b) acc[b] ^= block[b];
+        }
+        if (!store(missing, acc, blockLength(missing))) return Result::FAILED;
+        ++_recovered;
+        return Result::RECOVERED;
+    }
+};
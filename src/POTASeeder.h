@@ -0,0 +1,189 @@
+/*
+  POTASeeder.h - LAN seeder HTTP request handling for POTA
+  --------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air
+
+  Description:
+    Incremental parser for the requests a LAN seeder answers
+    (GET/HEAD of POTA_SEEDER_PATH with an optional byte Range) and
+    the matching response header. Bytes are fed as they arrive, so the
+    seeder never blocks loop() waiting for a slow or silent peer.
+
+    This header is platform independent: it is used by the POTA
+    library on the device and by the loopback test in extras/seeder.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#ifndef POTA_SEEDER_DEFAULT_PORT
+#define POTA_SEEDER_DEFAULT_PORT 8070        ///< Default TCP port used by the LAN seeder
+#endif
+#define POTA_SEEDER_PATH "/firmware.bin"     ///< HTTP path under which a seeder serves its image
+#ifndef POTA_SEEDER_REQUEST_MAX
+#define POTA_SEEDER_REQUEST_MAX 512          ///< Longest request head (request line and headers) accepted
+#endif
+#ifndef POTA_SEEDER_REQUEST_TIMEOUT_MS
+#define POTA_SEEDER_REQUEST_TIMEOUT_MS 2000  ///< A peer that sends no complete request in time is dropped
+#endif
+
+/**
+ * @brief State of a request being received.
+ */
+enum class POTASeederParse : uint8_t {
+    INCOMPLETE = 0, ///< More bytes needed
+    COMPLETE,       ///< Request head received and parsed
+    INVALID         ///< Not a GET/HEAD request, or head too long
+};
+
+/**
+ * @brief Request received by a seeder, parsed incrementally.
+ */
+class POTASeederRequest {
+public:
+    POTASeederRequest() { reset(); }
+
+    /**
+     * @brief Forget the previous request.
+     */
+    void reset() {
+        _len = 0;
+        _state = POTASeederParse::INCOMPLETE;
+        _head = _found = _ranged = _suffix = false;
+        _first = 0;
+        _last = UINT32_MAX;
+    }
+
+    /**
+     * @brief Append received bytes; bytes after the end of the head are ignored.
+     * @return State of the request
+     */
+    POTASeederParse feed(const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len && _state == POTASeederParse::INCOMPLETE; ++i) {
+            if (_len == POTA_SEEDER_REQUEST_MAX) {
+                _state = POTASeederParse::INVALID;
+                break;
+            }
+            char c = (char)data[i];
+            _buf[_len++] = c;
+            if (c != '\n') continue;
+            bool end = (_len >= 2 && _buf[_len - 2] == '\n') ||
+                       (_len >= 4 && memcmp(_buf + _len - 4, "\r\n\r\n", 4) == 0);
+            if (end) {
+                _buf[_len] = '\0';
+                _state = parse();
+            }
+        }
+        return _state;
+    }
+
+    POTASeederParse state() const { return _state; }
+    bool head() const { return _head; }     ///< HEAD request: headers only
+
+    /**
+     * @brief Resolve the request against an image.
+     * @param imageSize Size of the served image
+     * @param first First byte to send
+     * @param last Last byte to send (inclusive)
+     * @return HTTP status: 200, 206, 404 or 416
+     */
+    int resolve(uint32_t imageSize, uint32_t& first, uint32_t& last) const {
+        if (!_found || imageSize == 0) return 404;
+        last = _last < imageSize ? _last : imageSize - 1;
+        if (_suffix) first = _first < imageSize ? imageSize - _first : 0;
+        else first = _first;
+        if (first > last) return 416;
+        return _ranged ? 206 : 200;
+    }
+
+    /**
+     * @brief Format the response header for a resolved request.
+     * @return Header length, 0 if it does not fit `outSize`
+     */
+    static size_t formatHeader(char* out, size_t outSize, int status, uint32_t first, uint32_t last,
+                               uint32_t imageSize, const char* checksum) {
+        int n;
+        if (status == 404) {
+            n = snprintf(out, outSize, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        } else if (status == 416) {
+            n = snprintf(out, outSize,
+                         "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%lu\r\n"
+                         "Content-Length: 0\r\nConnection: close\r\n\r\n",
+                         (unsigned long)imageSize);
+        } else {
+            char range[64] = "";
+            if (status == 206) {
+                snprintf(range, sizeof(range), "Content-Range: bytes %lu-%lu/%lu\r\n",
+                         (unsigned long)first, (unsigned long)last, (unsigned long)imageSize);
+            }
+            n = snprintf(out, outSize,
+                         "HTTP/1.1 %s\r\n"
+                         "Content-Type: application/octet-stream\r\n"
+                         "Content-Length: %lu\r\n"
+                         "Accept-Ranges: bytes\r\n"
+                         "X-POTA-Checksum: %s\r\n"
+                         "%s"
+                         "Connection: close\r\n\r\n",
+                         status == 206 ? "206 Partial Content" : "200 OK",
+                         (unsigned long)(last - first + 1), checksum, range);
+        }
+        return n > 0 && (size_t)n < outSize ? (size_t)n : 0;
+    }
+
+private:
+    // Split the head into lines, keeping the method, the path match and the byte range
+    POTASeederParse parse() {
+        char* line = _buf;
+        char* eol = nextLine(line);
+        _head = strncmp(line, "HEAD ", 5) == 0;
+        if (!_head && strncmp(line, "GET ", 4) != 0) return POTASeederParse::INVALID;
+        const char* path = line + (_head ? 5 : 4);
+        _found = strncmp(path, POTA_SEEDER_PATH " ", strlen(POTA_SEEDER_PATH " ")) == 0;
+
+        while (eol && *(line = eol) != '\0') {
+            eol = nextLine(line);
+            if (*line == '\0') break; // End of headers
+            if (strncasecmp(line, "Range: bytes=", 13) != 0) continue;
+            _ranged = true;
+            if (line[13] == '-') {
+                // Suffix range: the last N bytes
+                _suffix = true;
+                _first = strtoul(line + 14, nullptr, 10);
+            } else {
+                char* end;
+                _first = strtoul(line + 13, &end, 10);
+                if (*end == '-' && isdigit((unsigned char)end[1])) _last = strtoul(end + 1, nullptr, 10);
+            }
+        }
+        return POTASeederParse::COMPLETE;
+    }
+
+    // Terminate the line at `line` (dropping CR LF) and return the start of the next one
+    static char* nextLine(char* line) {
+        char* eol = strchr(line, '\n');
+        if (!eol) return nullptr;
+        *eol = '\0';
+        if (eol > line && eol[-1] == '\r') eol[-1] = '\0';
+        return eol + 1;
+    }
+
+    char _buf[POTA_SEEDER_REQUEST_MAX + 1];
+    size_t _len;
+    POTASeederParse _state;
+    bool _head;         ///< HEAD request
+    bool _found;        ///< Path is POTA_SEEDER_PATH
+    bool _ranged;       ///< A Range header was sent
+    bool _suffix;       ///< Range is "bytes=-N" (_first holds N)
+    uint32_t _first;    ///< First requested byte
+    uint32_t _last;     ///< Last requested byte (UINT32_MAX: end of image)
+};
@@ -0,0 +1,333 @@
+/*
+  POTAShared.cpp - Thread-safe front end for the POTA library
+  -----------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air/
+
+  Description:
+    Locking, single-flight checks and the seqlock status (see POTAShared.h).
+*/
+
+#include "POTAShared.h"
+
+// -------------------- Waiters --------------------
+// A checkForUpdate() request parked on the check in flight; lives on its caller's stack
+struct POTAShared::Waiter {
+    POTAUpdateInfo* info;                ///< Where the result goes
+    POTAError err = POTAError::SUCCESS;  ///< Result of the joined check
+    Waiter* next = nullptr;
+#if defined(ESP32)
+    StaticSemaphore_t buffer;
+    SemaphoreHandle_t done;
+
+    explicit Waiter(POTAUpdateInfo& out) : info(&out), done(xSemaphoreCreateBinaryStatic(&buffer)) {}
+    ~Waiter() { vSemaphoreDelete(done); }
+    void wait() { xSemaphoreTake(done, portMAX_DELAY); }
+    void signal() { xSemaphoreGive(done); }
+#elif defined(ARDUINO_OPTA)
+    rtos::Semaphore done{0};
+
+    explicit Waiter(POTAUpdateInfo& out) : info(&out) {}
+    void wait() { done.acquire(); }
+    void signal() { done.release(); }
+#else
+    // Never parked: with a single thread no other check can be in flight
+    explicit Waiter(POTAUpdateInfo& out) : info(&out) {}
+    void wait() {}
+    void signal() {}
+#endif
+};
+
+// -------------------- Construction --------------------
+POTAShared::POTAShared(POTA& pota) : _pota(pota) {
+#if defined(ESP32)
+    _operation = xSemaphoreCreateRecursiveMutexStatic(&_operationBuffer);
+    _state = xSemaphoreCreateMutexStatic(&_stateBuffer);
+    _update = xSemaphoreCreateMutexStatic(&_updateBuffer);
+#endif
+    _pota.setYieldHook(onYield, this);
+}
+
+POTAShared::~POTAShared() {
+    _pota.setYieldHook(nullptr);
+#if defined(ESP32)
+    vSemaphoreDelete(_operation);
+    vSemaphoreDelete(_state);
+    vSemaphoreDelete(_update);
+#endif
+}
+
+// -------------------- Locks --------------------
+void POTAShared::lockOperation() {
+#if defined(ESP32)
+    xSemaphoreTakeRecursive(_operation, portMAX_DELAY);
+#elif defined(ARDUINO_OPTA)
+    _operation.lock();
+#endif
+}
+
+void POTAShared::unlockOperation() {
+#if defined(ESP32)
+    xSemaphoreGiveRecursive(_operation);
+#elif defined(ARDUINO_OPTA)
+    _operation.unlock();
+#endif
+}
+
+bool POTAShared::tryLockOperation() {
+#if defined(ESP32)
+    return xSemaphoreTakeRecursive(_operation, 0) == pdTRUE;
+#elif defined(ARDUINO_OPTA)
+    return _operation.trylock();
+#else
+    return true;
+#endif
+}
+
+void POTAShared::lockUpdate() {
+#if defined(ESP32)
+    xSemaphoreTake(_update, portMAX_DELAY);
+#elif defined(ARDUINO_OPTA)
+    _update.lock();
+#endif
+}
+
+void POTAShared::unlockUpdate() {
+#if defined(ESP32)
+    xSemaphoreGive(_update);
+#elif defined(ARDUINO_OPTA)
+    _update.unlock();
+#endif
+}
+
+void POTAShared::lockState() {
+#if defined(ESP32)
+    xSemaphoreTake(_state, portMAX_DELAY);
+#elif defined(ARDUINO_OPTA)
+    _state.lock();
+#endif
+}
+
+void POTAShared::unlockState() {
+#if defined(ESP32)
+    xSemaphoreGive(_state);
+#elif defined(ARDUINO_OPTA)
+    _state.unlock();
+#endif
+}
+
+bool POTAShared::onWorker() const {
+#if defined(ESP32)
+    return _worker == xTaskGetCurrentTaskHandle();
+#elif defined(ARDUINO_OPTA)
+    return _worker == rtos::ThisThread::get_id();
+#else
+    return _working;
+#endif
+}
+
+// Refused on the worker: its operation holds the (recursive) lock and must not see the configuration change
+POTAShared::Access::Access(POTAShared& owner) : _owner(owner.onWorker() ? nullptr : &owner) {
+    if (_owner) _owner->lockOperation();
+}
+
+POTAShared::Access::Access(Access&& other) noexcept : _owner(other._owner) {
+    other._owner = nullptr;
+}
+
+POTAShared::Access::~Access() {
+    if (_owner) _owner->unlockOperation();
+}
+
+POTAShared::Access POTAShared::access() {
+    return Access(*this);
+}
+
+// -------------------- Status --------------------
+// Seqlock: the single writer (the operation lock holder) makes the sequence odd
+// while it writes; readers retry until they copy the status between two equal,
+// even sequence values. Readers never take a lock, so a UI or telemetry task is
+// never held up by a download.
+void POTAShared::beginPublish() {
+    _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void POTAShared::endPublish() {
+    _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+POTAStatus POTAShared::status() const {
+    POTAStatus snapshot;
+    for (uint32_t attempt = 1;; ++attempt) {
+        uint32_t before = _seq.load(std::memory_order_acquire);
+        if ((before & 1) == 0) {
+            snapshot = _status;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_seq.load(std::memory_order_relaxed) == before) return snapshot;
+        }
+        // A higher-priority reader must let a preempted writer finish
+        if (attempt % 4 == 0) delay(1);
+    }
+}
+
+void POTAShared::setWorker(bool current) {
+#if defined(ESP32)
+    _worker = current ? xTaskGetCurrentTaskHandle() : nullptr;
+#elif defined(ARDUINO_OPTA)
+    _worker = current ? rtos::ThisThread::get_id() : nullptr;
+#else
+    _working = current;
+#endif
+}
+
+void POTAShared::enterOperation(POTAPhase phase) {
+    lockOperation();
+    setWorker(true);
+    beginPublish();
+    _status.phase = phase;
+    if (phase == POTAPhase::UPDATING) _status.progressBytes = _status.progressTotal = 0;
+    endPublish();
+}
+
+void POTAShared::finishOperation(POTAError err) {
+    uint32_t received = 0, total = 0;
+    _pota.getProgress(received, total);
+    beginPublish();
+    _status.phase = POTAPhase::IDLE;
+    _status.lastError = err;
+    _status.progressBytes = received;
+    _status.progressTotal = total;
+    _status.stats = _pota.getStats();
+    endPublish();
+    setWorker(false);
+    unlockOperation();
+}
+
+void POTAShared::publishCheck(POTAError err, const POTAUpdateInfo& info, uint32_t joined) {
+    beginPublish();
+    _status.checks++;
+    _status.joinedChecks += joined;
+    _status.updateAvailable = err == POTAError::SUCCESS && info.available;
+    strncpy(_status.version, _status.updateAvailable ? info.version : "", sizeof(_status.version) - 1);
+    _status.version[sizeof(_status.version) - 1] = '\0';
+    endPublish();
+}
+
+// Runs on the worker between download chunks, with the operation lock held
+void POTAShared::onYield(void* self) {
+    POTAShared* shared = static_cast<POTAShared*>(self);
+    uint32_t received = 0, total = 0;
+    shared->_pota.getProgress(received, total);
+    shared->beginPublish();
+    shared->_status.progressBytes = received;
+    shared->_status.progressTotal = total;
+    shared->endPublish();
+    if (shared->_userHook) shared->_userHook(shared->_userArg);
+}
+
+void POTAShared::setYieldHook(POTAYieldHook hook, void* arg) {
+    lockOperation();
+    _userArg = arg;
+    _userHook = hook;
+    unlockOperation();
+}
+
+// -------------------- Operations --------------------
+POTAError POTAShared::checkForUpdate(POTAUpdateInfo& info) {
+    if (onWorker()) return POTAError::OPERATION_IN_PROGRESS;
+
+    // Join the check in flight instead of asking the server again
+    lockState();
+    if (_checkInFlight) {
+        Waiter waiter(info);
+        waiter.next = _waiters;
+        _waiters = &waiter;
+        unlockState();
+        waiter.wait();
+        return waiter.err;
+    }
+    _checkInFlight = true;
+    unlockState();
+
+    enterOperation(POTAPhase::CHECKING);
+    POTAError err = _pota.checkForUpdate(info);
+
+    // Requests arriving from here on start a new check
+    lockState();
+    Waiter* waiters = _waiters;
+    _waiters = nullptr;
+    _checkInFlight = false;
+    unlockState();
+
+    uint32_t joined = 0;
+    for (Waiter* w = waiters; w; w = w->next) joined++;
+    publishCheck(err, info, joined);
+    finishOperation(err);
+
+    while (waiters) {
+        Waiter* next = waiters->next; // The node is gone once signalled
+        *waiters->info = info;
+        waiters->err = err;
+        waiters->signal();
+        waiters = next;
+    }
+    return err;
+}
+
+POTAError POTAShared::performUpdate(const POTAUpdateInfo& info) {
+    if (onWorker()) return POTAError::OPERATION_IN_PROGRESS;
+    enterOperation(POTAPhase::UPDATING);
+    POTAError err = _pota.performUpdate(info);
+    finishOperation(err);
+    return err;
+}
+
+POTAError POTAShared::checkAndPerformOTA() {
+    if (onWorker()) return POTAError::OPERATION_IN_PROGRESS;
+    lockUpdate(); // _info belongs to one caller at a time
+    POTAError err = checkForUpdate(_info);
+    if (err == POTAError::SUCCESS) {
+        // As POTA::checkAndPerformOTA(); the last download's progress stays in status()
+        err = _info.available ? performUpdate(_info) : POTAError::NO_UPDATE_AVAILABLE;
+    }
+    unlockUpdate();
+    return err;
+}
+
+POTAError POTAShared::retryDeferredUpdate() {
+    if (onWorker()) return POTAError::OPERATION_IN_PROGRESS;
+    enterOperation(POTAPhase::UPDATING);
+    POTAError err = _pota.retryDeferredUpdate();
+    finishOperation(err);
+    return err;
+}
+
+void POTAShared::loop() {
+    // The seeder and the canary must not run inside a download, nor wait for one
+    if (onWorker() || !tryLockOperation()) return;
+    setWorker(true);
+    _pota.loop();
+    setWorker(false);
+    unlockOperation();
+}
+
+// Flag stores only (see POTA::cancel()), safe while the worker holds the operation lock
+bool POTAShared::cancel() {
+    return _pota.cancel();
+}
+
+bool POTAShared::pause() {
+    return _pota.pause();
+}
+
+void POTAShared::resume() {
+    _pota.resume();
+}
+
+// A plain store the download loops re-read (see POTA::setDownloadRateLimit())
+void POTAShared::setDownloadRateLimit(uint32_t bytesPerSecond) {
+    _pota.setDownloadRateLimit(bytesPerSecond);
+}
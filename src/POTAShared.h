@@ -0,0 +1,224 @@
+/*
+  POTAShared.h - Thread-safe front end for the POTA library
+  ---------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air
+
+  Description:
+    POTA itself is not thread-safe: the TLS client, the update being
+    installed and the configuration are shared without locking.
+    POTAShared wraps one POTA instance so several FreeRTOS (ESP32) or
+    mbed (Arduino Opta) threads can use it:
+      - checks and updates run one at a time; checks requested while
+        one is in flight join it and all receive its result
+      - status() returns a consistent snapshot (phase, progress,
+        last result, statistics) through a seqlock, without ever
+        waiting for the thread doing the work
+      - access() gives exclusive access for configuration calls; the
+        configuration cannot change while a check or update runs
+      - cancel(), pause() and resume() act on a running download
+
+    On ESP8266 there are no threads; POTAShared only guards against a
+    check or update being started from the yield hook of another one.
+*/
+
+#pragma once
+
+#include "POTA.h"
+#include <atomic>
+
+#if defined(ESP32)
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/semphr.h>
+    #include <freertos/task.h>
+#elif defined(ARDUINO_OPTA)
+    #include <mbed.h>
+#endif
+
+/**
+ * @brief What a POTAShared is doing.
+ */
+enum class POTAPhase : uint8_t {
+    IDLE = 0,       ///< No operation running
+    CHECKING,       ///< An update check is in flight
+    UPDATING        ///< An update is being downloaded or installed
+};
+
+/**
+ * @brief Snapshot returned by POTAShared::status().
+ */
+struct POTAStatus {
+    POTAPhase phase = POTAPhase::IDLE;          ///< Current operation
+    POTAError lastError = POTAError::SUCCESS;   ///< Result of the last finished check or update
+    bool updateAvailable = false;               ///< The last check found an update
+    char version[32] = "";                      ///< Its version
+    uint32_t progressBytes = 0;                 ///< Image bytes received by the running (or last) download
+    uint32_t progressTotal = 0;                 ///< Its size (0 until known)
+    uint32_t checks = 0;                        ///< Checks performed (joined requests count once)
+    uint32_t joinedChecks = 0;                  ///< Check requests served by another in-flight check
+    POTAStats stats;                            ///< Statistics when the last operation finished
+};
+
+/**
+ * @brief Concurrency-safe front end of a POTA instance.
+ */
+class POTAShared {
+public:
+    /**
+     * @param pota Instance to wrap, already initialized with begin().
+     *             Its yield hook is taken over (see setYieldHook()).
+     */
+    explicit POTAShared(POTA& pota);
+    ~POTAShared();
+    POTAShared(const POTAShared&) = delete;
+    POTAShared& operator=(const POTAShared&) = delete;
+
+    /**
+     * @brief POTA::checkForUpdate(), single-flight.
+     *
+     * If a check is already running, waits for it and returns its result
+     * instead of starting another one.
+     * @return As POTA::checkForUpdate(); OPERATION_IN_PROGRESS if called
+     *         from the thread running a check or update (e.g. its yield hook)
+     */
+    POTAError checkForUpdate(POTAUpdateInfo& info);
+
+    /**
+     * @brief POTA::performUpdate(), serialized with every other operation.
+     */
+    POTAError performUpdate(const POTAUpdateInfo& info);
+
+    /**
+     * @brief checkForUpdate() followed by performUpdate() when an update is available.
+     *
+     * The check is single-flight like checkForUpdate(): it joins one in
+     * flight, and checks requested meanwhile join it. Calls are serialized.
+     * @return As POTA::checkAndPerformOTA()
+     */
+    POTAError checkAndPerformOTA();
+
+    /**
+     * @brief POTA::retryDeferredUpdate(), serialized like performUpdate().
+     */
+    POTAError retryDeferredUpdate();
+
+    /**
+     * @brief POTA::loop(), skipped (not waited for) while an operation runs.
+     */
+    void loop();
+
+    /**
+     * @brief Stop the running download (see POTA::cancel()). Callable from any thread.
+     */
+    bool cancel();
+
+    /**
+     * @brief Pause the running download (see POTA::pause()). Callable from any thread.
+     */
+    bool pause();
+
+    /**
+     * @brief Resume a paused download. Callable from any thread.
+     */
+    void resume();
+
+    /**
+     * @brief Change the download rate limit (see POTA::setDownloadRateLimit()).
+     *
+     * Callable from any thread, also while a download runs (e.g. from the
+     * yield hook, where access() is refused).
+     */
+    void setDownloadRateLimit(uint32_t bytesPerSecond);
+
+    /**
+     * @brief Consistent snapshot of phase, progress and last results. Never blocks.
+     */
+    POTAStatus status() const;
+
+    /**
+     * @brief Application hook called between download chunks, after the progress is published.
+     */
+    void setYieldHook(POTAYieldHook hook, void* arg = nullptr);
+
+    /**
+     * @brief Exclusive access to the wrapped instance, held until destroyed.
+     */
+    class Access {
+    public:
+        Access(Access&& other) noexcept;
+        ~Access();
+        Access(const Access&) = delete;
+        Access& operator=(const Access&) = delete;
+        explicit operator bool() const { return _owner != nullptr; } ///< false if refused
+        POTA* operator->() { return &_owner->_pota; }
+        POTA& operator*() { return _owner->_pota; }
+
+    private:
+        friend class POTAShared;
+        explicit Access(POTAShared& owner);
+        POTAShared* _owner;
+    };
+
+    /**
+     * @brief Lock the instance for configuration calls, e.g.
+     *        `shared.access()->setDownloadRateLimit(20000);`
+     *
+     * Waits while a check or update runs. From the thread running one
+     * (e.g. its yield hook) access is refused, so the configuration never
+     * changes mid-operation: the returned Access is false and must not be
+     * dereferenced. cancel(), pause(), resume() and setDownloadRateLimit()
+     * remain available there.
+     */
+    Access access();
+
+private:
+    struct Waiter;
+
+    void lockOperation();
+    void lockUpdate();
+    void unlockUpdate();
+    void unlockOperation();
+    bool tryLockOperation();
+    void lockState();
+    void unlockState();
+    bool onWorker() const;
+    void setWorker(bool current);
+    void enterOperation(POTAPhase phase);
+    void finishOperation(POTAError err);
+    void publishCheck(POTAError err, const POTAUpdateInfo& info, uint32_t joined);
+    void beginPublish();
+    void endPublish();
+    static void onYield(void* self);
+
+    POTA& _pota;
+    POTAYieldHook _userHook = nullptr;   ///< Application yield hook
+    void* _userArg = nullptr;            ///< Its argument
+    POTAUpdateInfo _info;                ///< Descriptor of checkAndPerformOTA(), kept off the caller's stack (guarded by _update)
+
+    // Single-flight checks (guarded by the state lock)
+    bool _checkInFlight = false;         ///< A check is running or waiting for the operation lock
+    Waiter* _waiters = nullptr;          ///< Requests waiting for its result
+
+    // Seqlock-protected status, written only by the thread holding the operation lock
+    std::atomic<uint32_t> _seq{0};       ///< Odd while _status is being written
+    POTAStatus _status;
+
+#if defined(ESP32)
+    StaticSemaphore_t _operationBuffer;
+    SemaphoreHandle_t _operation;        ///< Recursive: setYieldHook() works from the worker's yield hook
+    StaticSemaphore_t _stateBuffer;
+    SemaphoreHandle_t _state;
+    StaticSemaphore_t _updateBuffer;
+    SemaphoreHandle_t _update;           ///< One checkAndPerformOTA() at a time
+    volatile TaskHandle_t _worker = nullptr; ///< Task running the current operation
+#elif defined(ARDUINO_OPTA)
+    rtos::Mutex _operation;              ///< Recursive, like every mbed Mutex
+    rtos::Mutex _state;
+    rtos::Mutex _update;                 ///< One checkAndPerformOTA() at a time
+    volatile osThreadId_t _worker = nullptr; ///< Thread running the current operation
+#else
+    bool _working = false;               ///< An operation is running (single thread)
+#endif
+};
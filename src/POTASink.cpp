@@ -0,0 +1,245 @@
+/*
+  POTASink.cpp - Update sinks for the POTA library
+  ------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air/
+
+  Description:
+    External flash, downstream MCU and file sinks (see POTASink.h).
+    The built-in POTAOtaSink lives in POTA.cpp next to the platform
+    OTA code it shares.
+*/
+
+#include "POTASink.h"
+
+#if !defined(ESP8266)
+    #include <stdio.h>
+#endif
+
+// -------------------- External Flash --------------------
+POTAFlashRegionSink::POTAFlashRegionSink(POTAFlashDevice& device, uint32_t address, uint32_t size)
+    : _device(device), _address(address), _size(size) {}
+
+POTAError POTAFlashRegionSink::begin(size_t size) {
+    if (size > _size) return POTAError::IMAGE_TOO_LARGE;
+    _imageSize = size;
+    _written = 0;
+    _erasedTo = 0;
+    _complete = false;
+    return POTAError::SUCCESS;
+}
+
+bool POTAFlashRegionSink::write(const uint8_t* data, size_t len) {
+    if (_written + len > _imageSize) return false;
+    // Erase only the sectors the write is about to reach
+    uint32_t sector = _device.eraseSize();
+    while (_erasedTo < _written + len) {
+        if (!_device.erase(_address + _erasedTo, sector)) return false;
+        _erasedTo += sector;
+    }
+    if (!_device.program(_address + _written, data, len)) return false;
+    _written += len;
+    return true;
+}
+
+POTAError POTAFlashRegionSink::finalize(const uint8_t* digest) {
+    if (_written != _imageSize) return POTAError::OTA_WRITE_FAILED;
+
+    // Read back: a weak or worn sector must not leave a corrupted image behind
+    POTASha256 sha;
+    uint8_t buffer[256];
+    for (uint32_t offset = 0; offset < _imageSize; offset += sizeof(buffer)) {
+        size_t n = _imageSize - offset < sizeof(buffer) ? _imageSize - offset : sizeof(buffer);
+        if (!_device.read(_address + offset, buffer, n)) return POTAError::OTA_WRITE_FAILED;
+        sha.update(buffer, n);
+    }
+    uint8_t readBack[POTA_SHA256_SIZE];
+    sha.finish(readBack);
+    if (memcmp(readBack, digest, sizeof(readBack)) != 0) {
+        Serial.println("❌ External flash read-back does not match the image");
+        return POTAError::OTA_WRITE_FAILED;
+    }
+    _complete = true;
+    return POTAError::SUCCESS;
+}
+
+void POTAFlashRegionSink::abort() {
+    // Sectors are left as they are; the next begin() erases them again
+    _written = 0;
+    _erasedTo = 0;
+    _complete = false;
+}
+
+// -------------------- Downstream MCU --------------------
+#define POTA_SERIAL_ACK 0x06
+#define POTA_SERIAL_NAK 0x15
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+static uint16_t crc16(uint16_t crc, const uint8_t* data, size_t len) {
+    while (len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint8_t bit = 0; bit < 8; ++bit) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+POTASerialSink::POTASerialSink(Stream& link, size_t maxImageSize)
+    : _link(link), _maxImageSize(maxImageSize) {}
+
+bool POTASerialSink::sendFrame(char type, const uint8_t* payload, uint16_t len, uint32_t timeoutMs) {
+    uint8_t head[3] = {(uint8_t)type, (uint8_t)(len & 0xFF), (uint8_t)(len >> 8)};
+    uint16_t crc = crc16(crc16(0xFFFF, head, sizeof(head)), payload, len);
+    uint8_t tail[2] = {(uint8_t)(crc & 0xFF), (uint8_t)(crc >> 8)};
+
+    for (uint8_t attempt = 0; attempt <= POTA_SERIAL_SINK_RETRIES; ++attempt) {
+        while (_link.available()) _link.read(); // Drop stale replies
+        _link.write(head, sizeof(head));
+        if (len) _link.write(payload, len);
+        _link.write(tail, sizeof(tail));
+        _link.flush();
+        if (timeoutMs == 0) return true;
+
+        unsigned long start = millis();
+        int reply = -1;
+        while (reply < 0 && millis() - start < timeoutMs) {
+            reply = _link.read();
+            if (reply < 0) delay(1);
+        }
+        if (reply == POTA_SERIAL_ACK) return true;
+        if (reply != POTA_SERIAL_NAK) break; // Silent or confused receiver: do not flood it
+    }
+    return false;
+}
+
+POTAError POTASerialSink::begin(size_t size) {
+    if (size > _maxImageSize) return POTAError::IMAGE_TOO_LARGE;
+    uint8_t payload[4] = {(uint8_t)size, (uint8_t)(size >> 8), (uint8_t)(size >> 16), (uint8_t)(size >> 24)};
+    if (!sendFrame('B', payload, sizeof(payload), POTA_SERIAL_SINK_SLOW_TIMEOUT_MS)) {
+        Serial.println("❌ Downstream MCU did not accept the image");
+        return POTAError::OTA_BEGIN_FAILED;
+    }
+    return POTAError::SUCCESS;
+}
+
+bool POTASerialSink::write(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        uint16_t n = len > POTA_SERIAL_SINK_FRAME ? POTA_SERIAL_SINK_FRAME : (uint16_t)len;
+        if (!sendFrame('D', data, n, POTA_SERIAL_SINK_TIMEOUT_MS)) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+POTAError POTASerialSink::finalize(const uint8_t* digest) {
+    if (!sendFrame('F', digest, POTA_SHA256_SIZE, POTA_SERIAL_SINK_SLOW_TIMEOUT_MS)) {
+        Serial.println("❌ Downstream MCU rejected the image");
+        return POTAError::OTA_APPLY_FAILED;
+    }
+    return POTAError::SUCCESS;
+}
+
+void POTASerialSink::abort() {
+    sendFrame('X', nullptr, 0, 0);
+}
+
+// -------------------- File --------------------
+#if defined(ESP8266)
+POTAFileSink::POTAFileSink(fs::FS& fs, const char* path) : _fs(fs) {
+#else
+POTAFileSink::POTAFileSink(const char* path) {
+#endif
+    strncpy(_path, path ? path : "", sizeof(_path) - 1);
+    _path[sizeof(_path) - 1] = '\0';
+    snprintf(_partPath, sizeof(_partPath), "%s.part", _path);
+    snprintf(_oldPath, sizeof(_oldPath), "%s.old", _path);
+}
+
+#if defined(ESP8266)
+POTAError POTAFileSink::begin(size_t size) {
+    (void)size;
+    _file = _fs.open(_partPath, "w");
+    _written = 0;
+    return _file ? POTAError::SUCCESS : POTAError::OTA_BEGIN_FAILED;
+}
+
+bool POTAFileSink::write(const uint8_t* data, size_t len) {
+    if (!_file || _file.write(data, len) != len) return false;
+    _written += len;
+    return true;
+}
+
+POTAError POTAFileSink::finalize(const uint8_t* digest) {
+    (void)digest; // Already matched by the download pipeline
+    if (!_file) return POTAError::OTA_WRITE_FAILED;
+    _file.close();
+
+    // File::close() reports nothing: reopen the part file to confirm it was committed whole
+    fs::File check = _fs.open(_partPath, "r");
+    bool ok = check && check.size() == _written;
+    if (check) check.close();
+    if (!ok) {
+        _fs.remove(_partPath);
+        return POTAError::OTA_WRITE_FAILED;
+    }
+
+    // Not every file system renames over an existing file: move the old image aside
+    bool hadOld = _fs.exists(_path);
+    _fs.remove(_oldPath);
+    if (hadOld && !_fs.rename(_path, _oldPath)) return POTAError::OTA_WRITE_FAILED;
+    if (!_fs.rename(_partPath, _path)) {
+        if (hadOld) _fs.rename(_oldPath, _path);
+        return POTAError::OTA_WRITE_FAILED;
+    }
+    if (hadOld) _fs.remove(_oldPath);
+    return POTAError::SUCCESS;
+}
+
+void POTAFileSink::abort() {
+    if (_file) _file.close();
+    _fs.remove(_partPath);
+}
+
+#else
+POTAError POTAFileSink::begin(size_t size) {
+    (void)size;
+    if (_file) fclose(_file);
+    _file = fopen(_partPath, "wb");
+    return _file ? POTAError::SUCCESS : POTAError::OTA_BEGIN_FAILED;
+}
+
+bool POTAFileSink::write(const uint8_t* data, size_t len) {
+    return _file && fwrite(data, 1, len, _file) == len;
+}
+
+POTAError POTAFileSink::finalize(const uint8_t* digest) {
+    (void)digest; // Already matched by the download pipeline
+    bool ok = _file && fclose(_file) == 0;
+    _file = nullptr;
+    if (!ok) {
+        remove(_partPath);
+        return POTAError::OTA_WRITE_FAILED;
+    }
+
+    // Not every file system renames over an existing file: move the old image aside
+    FILE* old = fopen(_path, "rb");
+    bool hadOld = old != nullptr;
+    if (old) fclose(old);
+    remove(_oldPath);
+    if (hadOld && rename(_path, _oldPath) != 0) return POTAError::OTA_WRITE_FAILED;
+    if (rename(_partPath, _path) != 0) {
+        if (hadOld) rename(_oldPath, _path);
+        return POTAError::OTA_WRITE_FAILED;
+    }
+    if (hadOld) remove(_oldPath);
+    return POTAError::SUCCESS;
+}
+
+void POTAFileSink::abort() {
+    if (_file) fclose(_file);
+    _file = nullptr;
+    remove(_partPath);
+}
+#endif
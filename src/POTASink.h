@@ -0,0 +1,170 @@
+/*
+  POTASink.h - Update sinks for the POTA library
+  ----------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air
+
+  Description:
+    Destinations for images downloaded by POTA other than the device's
+    own OTA target (POTAOtaSink, see POTA.h). Pass one to
+    POTA::setUpdateSink() and the same streaming pipeline (resume,
+    mirrors, rate limit, chunk and SHA-256 verification) feeds it:
+      - POTAFlashRegionSink: a raw region of an external SPI flash,
+        driven through a small POTAFlashDevice adapter
+      - POTASerialSink: forwards the image to a downstream MCU over a
+        UART with a framed, acknowledged protocol
+      - POTAFileSink: a file (LittleFS on ESP8266, the C library file
+        system elsewhere, e.g. /fs on Opta or a mounted VFS on ESP32)
+*/
+
+#pragma once
+
+#include "POTA.h"
+#include "POTASource.h"
+
+#if defined(ESP8266)
+    #include <FS.h>
+#endif
+
+#ifndef POTA_SERIAL_SINK_FRAME
+#define POTA_SERIAL_SINK_FRAME 256          ///< Largest payload of a POTASerialSink data frame
+#endif
+#ifndef POTA_SERIAL_SINK_TIMEOUT_MS
+#define POTA_SERIAL_SINK_TIMEOUT_MS 1000    ///< Wait for the acknowledgement of a data frame
+#endif
+#ifndef POTA_SERIAL_SINK_SLOW_TIMEOUT_MS
+#define POTA_SERIAL_SINK_SLOW_TIMEOUT_MS 30000 ///< Wait for begin/finalize (the receiver may erase or verify)
+#endif
+#ifndef POTA_SERIAL_SINK_RETRIES
+#define POTA_SERIAL_SINK_RETRIES 3          ///< Resends of a frame that was not acknowledged
+#endif
+
+// -------------------- External Flash --------------------
+/**
+ * @brief Minimal driver interface of an external flash chip.
+ *
+ * Wrap the application's SPI flash driver (e.g. SerialFlash, SPIMemory,
+ * an mbed BlockDevice) in a subclass; read() comes from POTABlockReader,
+ * so the same adapter can serve a POTABlockSource.
+ */
+class POTAFlashDevice : public POTABlockReader {
+public:
+    virtual uint32_t eraseSize() const = 0;                                     ///< Erase granularity in bytes
+    virtual bool erase(uint32_t address, uint32_t len) = 0;                     ///< Erase whole sectors
+    virtual bool program(uint32_t address, const uint8_t* data, size_t len) = 0; ///< Program erased bytes
+};
+
+/**
+ * @brief Writes the image to a region of an external flash.
+ *
+ * Sectors are erased just ahead of the write position, so the download
+ * is never stalled by a full-region erase. finalize() reads the image
+ * back and checks it against the verified digest.
+ */
+class POTAFlashRegionSink : public POTAUpdateSink {
+public:
+    /**
+     * @param device Flash driver
+     * @param address Start of the region (sector aligned)
+     * @param size Size of the region in bytes
+     */
+    POTAFlashRegionSink(POTAFlashDevice& device, uint32_t address, uint32_t size);
+
+    POTAError begin(size_t size) override;
+    bool write(const uint8_t* data, size_t len) override;
+    POTAError finalize(const uint8_t* digest) override;
+    void abort() override;
+    size_t capacity() override { return _size; }
+
+    /**
+     * @brief Size of the last complete image (0 if none).
+     */
+    uint32_t imageSize() const { return _complete ? _imageSize : 0; }
+
+private:
+    POTAFlashDevice& _device;
+    uint32_t _address;          ///< Region start
+    uint32_t _size;             ///< Region size
+    uint32_t _imageSize = 0;    ///< Size announced by begin()
+    uint32_t _written = 0;      ///< Bytes programmed so far
+    uint32_t _erasedTo = 0;     ///< Region offset up to which sectors are erased
+    bool _complete = false;     ///< finalize() verified the image
+};
+
+// -------------------- Downstream MCU --------------------
+/**
+ * @brief Forwards the image to a downstream MCU over a serial link.
+ *
+ * Every frame is `type`, `length` (uint16, little endian), payload and
+ * a CRC-16/CCITT-FALSE of type, length and payload (little endian).
+ * The receiver answers each frame with 0x06 (ACK) or 0x15 (NAK, the
+ * frame is resent):
+ *   - 'B' uint32 image size: prepare (e.g. erase) storage
+ *   - 'D' up to POTA_SERIAL_SINK_FRAME image bytes, in order
+ *   - 'F' 32-byte SHA-256 of the image: verify and install
+ *   - 'X' no payload: discard the partial image (not acknowledged)
+ */
+class POTASerialSink : public POTAUpdateSink {
+public:
+    /**
+     * @param link Serial port connected to the downstream MCU (already started)
+     * @param maxImageSize Largest image the downstream MCU accepts
+     */
+    explicit POTASerialSink(Stream& link, size_t maxImageSize = SIZE_MAX);
+
+    POTAError begin(size_t size) override;
+    bool write(const uint8_t* data, size_t len) override;
+    POTAError finalize(const uint8_t* digest) override;
+    void abort() override;
+    size_t capacity() override { return _maxImageSize; }
+
+private:
+    bool sendFrame(char type, const uint8_t* payload, uint16_t len, uint32_t timeoutMs);
+
+    Stream& _link;
+    size_t _maxImageSize;
+};
+
+// -------------------- File --------------------
+/**
+ * @brief Writes the image to a file.
+ *
+ * The file is written under `<path>.part` and renamed to `path` by
+ * finalize(), so `path` only ever holds a complete, verified image.
+ * A previous image is moved to `<path>.old` for the rename and put
+ * back if it fails.
+ */
+class POTAFileSink : public POTAUpdateSink {
+public:
+#if defined(ESP8266)
+    /**
+     * @param fs Mounted file system (e.g. LittleFS)
+     * @param path Destination file
+     */
+    POTAFileSink(fs::FS& fs, const char* path);
+#else
+    /**
+     * @param path Destination file on a mounted file system (e.g. "/fs/coproc.bin")
+     */
+    explicit POTAFileSink(const char* path);
+#endif
+
+    POTAError begin(size_t size) override;
+    bool write(const uint8_t* data, size_t len) override;
+    POTAError finalize(const uint8_t* digest) override;
+    void abort() override;
+
+private:
+    char _path[64];
+    char _partPath[70];
+    char _oldPath[70];
+#if defined(ESP8266)
+    fs::FS& _fs;
+    fs::File _file;
+    size_t _written = 0;    ///< Bytes written to the part file
+#else
+    FILE* _file = nullptr;
+#endif
+};
@@ -0,0 +1,131 @@
+/*
+  POTASource.cpp - Local image sources for the POTA library
+  ---------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air/
+
+  Description:
+    Block device and file sources (see POTASource.h).
+*/
+
+#include "POTASource.h"
+
+#if !defined(ESP8266)
+    #include <stdio.h>
+#endif
+
+// -------------------- Block Devices --------------------
+POTABlockSource::POTABlockSource(POTABlockReader& device, uint32_t address, uint32_t size, uint32_t descriptorAddress)
+    : _device(device), _address(address), _size(size), _descriptorAddress(descriptorAddress) {}
+
+size_t POTABlockSource::readDescriptor(char* out, size_t outSize) {
+    if (outSize == 0) return 0;
+    out[0] = '\0';
+    if (!_device.read(_descriptorAddress, (uint8_t*)out, outSize - 1)) return 0;
+    size_t len = 0;
+    while (len < outSize - 1 && out[len] != '\0' && (uint8_t)out[len] != 0xFF) ++len;
+    out[len] = '\0';
+    return len;
+}
+
+POTAError POTABlockSource::open(size_t& size) {
+    _offset = 0;
+    size = _size;
+    return POTAError::SUCCESS;
+}
+
+size_t POTABlockSource::read(uint8_t* buffer, size_t len) {
+    if (len > _size - _offset) len = _size - _offset;
+    if (len == 0 || !_device.read(_address + _offset, buffer, len)) return 0;
+    _offset += len;
+    return len;
+}
+
+// -------------------- Files --------------------
+#if defined(ESP8266)
+POTAFileSource::POTAFileSource(fs::FS& fs, const char* path, const char* descriptorPath) : _fs(fs) {
+#else
+POTAFileSource::POTAFileSource(const char* path, const char* descriptorPath) {
+#endif
+    strncpy(_path, path ? path : "", sizeof(_path) - 1);
+    _path[sizeof(_path) - 1] = '\0';
+    if (descriptorPath) {
+        strncpy(_descriptorPath, descriptorPath, sizeof(_descriptorPath) - 1);
+        _descriptorPath[sizeof(_descriptorPath) - 1] = '\0';
+    } else {
+        snprintf(_descriptorPath, sizeof(_descriptorPath), "%s.json", _path);
+    }
+}
+
+#if defined(ESP8266)
+POTAFileSource::~POTAFileSource() {
+    close();
+}
+
+size_t POTAFileSource::readDescriptor(char* out, size_t outSize) {
+    if (outSize == 0) return 0;
+    fs::File f = _fs.open(_descriptorPath, "r");
+    if (!f) return 0;
+    size_t len = f.read((uint8_t*)out, outSize - 1);
+    f.close();
+    out[len] = '\0';
+    return len;
+}
+
+POTAError POTAFileSource::open(size_t& size) {
+    _file = _fs.open(_path, "r");
+    if (!_file) return POTAError::SOURCE_READ_FAILED;
+    size = _file.size();
+    return POTAError::SUCCESS;
+}
+
+size_t POTAFileSource::read(uint8_t* buffer, size_t len) {
+    return _file ? _file.read(buffer, len) : 0;
+}
+
+void POTAFileSource::close() {
+    if (_file) _file.close();
+}
+
+#else
+POTAFileSource::~POTAFileSource() {
+    close();
+}
+
+size_t POTAFileSource::readDescriptor(char* out, size_t outSize) {
+    if (outSize == 0) return 0;
+    FILE* f = fopen(_descriptorPath, "rb");
+    if (!f) return 0;
+    size_t len = fread(out, 1, outSize - 1, f);
+    fclose(f);
+    out[len] = '\0';
+    return len;
+}
+
+POTAError POTAFileSource::open(size_t& size) {
+    close();
+    _file = fopen(_path, "rb");
+    if (!_file) return POTAError::SOURCE_READ_FAILED;
+    // Whole-sector reads go straight to the caller's buffer, no stdio copy in between
+    setvbuf(_file, nullptr, _IONBF, 0);
+    long end = -1;
+    if (fseek(_file, 0, SEEK_END) == 0) end = ftell(_file);
+    if (end <= 0 || fseek(_file, 0, SEEK_SET) != 0) {
+        close();
+        return POTAError::SOURCE_READ_FAILED;
+    }
+    size = (size_t)end;
+    return POTAError::SUCCESS;
+}
+
+size_t POTAFileSource::read(uint8_t* buffer, size_t len) {
+    return _file ? fread(buffer, 1, len, _file) : 0;
+}
+
+void POTAFileSource::close() {
+    if (_file) fclose(_file);
+    _file = nullptr;
+}
+#endif
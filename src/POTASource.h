@@ -0,0 +1,109 @@
+/*
+  POTASource.h - Local image sources for the POTA library
+  -------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air
+
+  Description:
+    Images installed with POTA::performLocalUpdate() instead of being
+    downloaded, e.g. for factory programming and field service:
+      - POTAFileSource: an image file and its signed descriptor on a
+        mounted file system (SD card, USB mass storage, LittleFS)
+      - POTABlockSource: an image stored raw on a block device (SD
+        card sectors, external flash), read through POTABlockReader
+
+    The descriptor is the JSON reply of the update server for this
+    device, or one built with extras/local/gen_descriptor.py from the
+    same secret; its server token is verified before any byte of the
+    image is written. Reads are POTA_LOCAL_READ_SIZE bytes, so keep
+    raw images aligned to the device's block size.
+*/
+
+#pragma once
+
+#include "POTA.h"
+
+#if defined(ESP8266)
+    #include <FS.h>
+#endif
+
+// -------------------- Block Devices --------------------
+/**
+ * @brief Read side of a block device (SD card, external flash).
+ *
+ * Wrap the application's driver in a subclass.
+ */
+class POTABlockReader {
+public:
+    virtual ~POTABlockReader() {}
+    virtual bool read(uint32_t address, uint8_t* data, size_t len) = 0; ///< Read `len` bytes at `address`
+};
+
+/**
+ * @brief Image stored raw on a block device.
+ *
+ * The descriptor is stored as text at its own address, ended by a NUL
+ * or an erased (0xFF) byte.
+ */
+class POTABlockSource : public POTAUpdateSource {
+public:
+    /**
+     * @param device Block device
+     * @param address Start of the image (block aligned)
+     * @param size Image size in bytes
+     * @param descriptorAddress Start of the signed descriptor
+     */
+    POTABlockSource(POTABlockReader& device, uint32_t address, uint32_t size, uint32_t descriptorAddress);
+
+    size_t readDescriptor(char* out, size_t outSize) override;
+    POTAError open(size_t& size) override;
+    size_t read(uint8_t* buffer, size_t len) override;
+    void close() override {}
+
+private:
+    POTABlockReader& _device;
+    uint32_t _address;              ///< Image start
+    uint32_t _size;                 ///< Image size
+    uint32_t _descriptorAddress;    ///< Descriptor start
+    uint32_t _offset = 0;           ///< Next image byte to read
+};
+
+// -------------------- Files --------------------
+/**
+ * @brief Image file with its descriptor next to it (`<path>.json` by default).
+ */
+class POTAFileSource : public POTAUpdateSource {
+public:
+#if defined(ESP8266)
+    /**
+     * @param fs Mounted file system (e.g. LittleFS, SDFS)
+     * @param path Image file
+     * @param descriptorPath Descriptor file, or nullptr for `<path>.json`
+     */
+    POTAFileSource(fs::FS& fs, const char* path, const char* descriptorPath = nullptr);
+#else
+    /**
+     * @param path Image file on a mounted file system (e.g. "/sd/firmware.bin", "/usb/firmware.bin")
+     * @param descriptorPath Descriptor file, or nullptr for `<path>.json`
+     */
+    explicit POTAFileSource(const char* path, const char* descriptorPath = nullptr);
+#endif
+    ~POTAFileSource();
+
+    size_t readDescriptor(char* out, size_t outSize) override;
+    POTAError open(size_t& size) override;
+    size_t read(uint8_t* buffer, size_t len) override;
+    void close() override;
+
+private:
+    char _path[64];
+    char _descriptorPath[70];
+#if defined(ESP8266)
+    fs::FS& _fs;
+    fs::File _file;
+#else
+    FILE* _file = nullptr;
+#endif
+};
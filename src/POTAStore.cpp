@@ -0,0 +1,113 @@
+/*
+  POTAStore.cpp - Small persistent key/value store for the POTA library
+  ---------------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air/
+
+  Description:
+    Platform implementations of POTAStore (see POTAStore.h).
+*/
+
+#include "POTAStore.h"
+
+#if defined(ESP32)
+    #include <Preferences.h>
+#elif defined(ESP8266)
+    #include <LittleFS.h>
+#elif defined(ARDUINO_OPTA)
+    #include "kvstore_global_api.h"
+#endif
+
+#if defined(ESP32)
+// -------------------- ESP32 (NVS) --------------------
+bool POTAStore::load(const char* key, void* data, size_t len) {
+    Preferences prefs;
+    if (!prefs.begin("pota", true)) return false;
+    bool ok = prefs.getBytesLength(key) == len && prefs.getBytes(key, data, len) == len;
+    prefs.end();
+    return ok;
+}
+
+bool POTAStore::save(const char* key, const void* data, size_t len) {
+    Preferences prefs;
+    if (!prefs.begin("pota", false)) return false;
+    bool ok = prefs.putBytes(key, data, len) == len;
+    prefs.end();
+    return ok;
+}
+
+void POTAStore::remove(const char* key) {
+    Preferences prefs;
+    if (!prefs.begin("pota", false)) return;
+    prefs.remove(key);
+    prefs.end();
+}
+
+#elif defined(ESP8266)
+// -------------------- ESP8266 (LittleFS) --------------------
+static bool mountFS() {
+    static bool mounted = false;
+    if (!mounted) mounted = LittleFS.begin();
+    return mounted;
+}
+
+static void keyPath(const char* key, char* path, size_t size) {
+    snprintf(path, size, "/pota_%s", key);
+}
+
+bool POTAStore::load(const char* key, void* data, size_t len) {
+    if (!mountFS()) return false;
+    char path[32];
+    keyPath(key, path, sizeof(path));
+    File f = LittleFS.open(path, "r");
+    if (!f) return false;
+    bool ok = f.size() == len && f.read((uint8_t*)data, len) == len;
+    f.close();
+    return ok;
+}
+
+bool POTAStore::save(const char* key, const void* data, size_t len) {
+    if (!mountFS()) return false;
+    char path[32];
+    keyPath(key, path, sizeof(path));
+    File f = LittleFS.open(path, "w");
+    if (!f) return false;
+    bool ok = f.write((const uint8_t*)data, len) == len;
+    f.close();
+    return ok;
+}
+
+void POTAStore::remove(const char* key) {
+    if (!mountFS()) return;
+    char path[32];
+    keyPath(key, path, sizeof(path));
+    LittleFS.remove(path);
+}
+
+#elif defined(ARDUINO_OPTA)
+// -------------------- Arduino Opta (KVStore) --------------------
+static void keyPath(const char* key, char* path, size_t size) {
+    snprintf(path, size, "/kv/pota_%s", key);
+}
+
+bool POTAStore::load(const char* key, void* data, size_t len) {
+    char path[32];
+    keyPath(key, path, sizeof(path));
+    size_t actual = 0;
+    return kv_get(path, data, len, &actual) == 0 && actual == len;
+}
+
+bool POTAStore::save(const char* key, const void* data, size_t len) {
+    char path[32];
+    keyPath(key, path, sizeof(path));
+    return kv_set(path, data, len, 0) == 0;
+}
+
+void POTAStore::remove(const char* key) {
+    char path[32];
+    keyPath(key, path, sizeof(path));
+    kv_remove(path);
+}
+#endif
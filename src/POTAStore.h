@@ -0,0 +1,48 @@
+/*
+  POTAStore.h - Small persistent key/value store for the POTA library
+  -------------------------------------------------------------------
+  Author: Francesco Alessandro Colucci (pleasedontcode.com)
+  License: MIT (see LICENSE file in the root of this project)
+  Repository: https://github.com/pleasedontcode/POTA
+  Website/Service: https://www.pleasedontcode.com/please-over-the-air
+
+  Description:
+    Persists small blobs (e.g. the preferred download mirror) across
+    reboots and updates, using the storage each platform already
+    provides:
+      - ESP32: NVS via Preferences (namespace "pota")
+      - ESP8266: LittleFS files named /pota_<key>
+      - Arduino Opta: mbed KVStore keys /kv/pota_<key>
+
+    Keys must be at most 15 characters (NVS limit).
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Persistent key/value storage for library state.
+ */
+class POTAStore {
+public:
+    /**
+     * @brief Load a blob.
+     * @param key Key name
+     * @param data Output buffer
+     * @param len Expected size in bytes
+     * @return true if the key exists and has exactly `len` bytes
+     */
+    static bool load(const char* key, void* data, size_t len);
+
+    /**
+     * @brief Store a blob, replacing any previous value.
+     * @return true on success
+     */
+    static bool save(const char* key, const void* data, size_t len);
+
+    /**
+     * @brief Delete a key.
+     */
+    static void remove(const char* key);
+};
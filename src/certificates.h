@@ -15,7 +15,10 @@
     Include this file in your sketch or POTA.cpp:
       #include "certificates.h"
 
-    The variable `root_ca` is used internally by the POTA library.
+    The variable `root_ca` is used internally by the POTA library
+    where a PEM root is required (esp_https_ota on Arduino-ESP32 2.x).
+    All other connections trust the generated POTACertBundle.h; run
+    extras/ca_bundle/gen_ca_bundle.py to add roots.
 */
 
 #pragma once